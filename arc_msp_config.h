@@ -0,0 +1,17 @@
+/*
+Andrew R. Courtemanche 2020/12
+*/
+
+#ifndef ARC_MSP_CONFIG_GUARD
+#define ARC_MSP_CONFIG_GUARD
+
+//options here change the layout of structs in arc_msp_helper.h, so every file that includes it must see the same values
+//change them here or on the compiler command line for the whole build, never with a #define in a single source file
+#ifndef ARC_MSP_CONFIG_ARCOS_EVENTS
+    #define ARC_MSP_CONFIG_ARCOS_EVENTS (1) //1 adds pinInterruptEvent(), which binds a pin interrupt to ARCOS event flags, and an event per pin to struct port_callbacks_s
+#endif
+#ifdef ARC_MSP_USE_ARCOS_EVENTS
+    #error ARC_MSP_USE_ARCOS_EVENTS is replaced by ARC_MSP_CONFIG_ARCOS_EVENTS in arc_msp_config.h
+#endif
+
+#endif //end include guard
@@ -7,6 +7,8 @@ Updated 2020/12
 #define ARC_MSP_TYPE_msp430fr6989
 #include "arc_msp_helper.h"
 
+#include "arcos.h" //port ISRs are recorded in the arcos trace buffer using the port number as the ISR id, ARCOS_CONFIG_TRACE_SIZE 0 compiles it out
+
 #include <msp430.h>
 
 //PxDIR is 0 for input
@@ -28,10 +30,10 @@ const struct pin_mode_s pin_mode_input_pullup =   {.dir = 0, .out = 1, .ren = 1}
 const struct pin_mode_s pin_mode_input_pulldown = {.dir = 0, .out = 0, .ren = 1};
 const struct pin_mode_s pin_mode_output =         {.dir = 1, .out = 0, .ren = 0};
 
-struct port_callbacks_s port1_cb = {{&dummy, &dummy, &dummy, &dummy, &dummy, &dummy, &dummy, &dummy}};
-struct port_callbacks_s port2_cb = {{&dummy, &dummy, &dummy, &dummy, &dummy, &dummy, &dummy, &dummy}};
-struct port_callbacks_s port3_cb = {{&dummy, &dummy, &dummy, &dummy, &dummy, &dummy, &dummy, &dummy}};
-struct port_callbacks_s port4_cb = {{&dummy, &dummy, &dummy, &dummy, &dummy, &dummy, &dummy, &dummy}};
+struct port_callbacks_s port1_cb = {.callbacks = {&dummy, &dummy, &dummy, &dummy, &dummy, &dummy, &dummy, &dummy}};
+struct port_callbacks_s port2_cb = {.callbacks = {&dummy, &dummy, &dummy, &dummy, &dummy, &dummy, &dummy, &dummy}};
+struct port_callbacks_s port3_cb = {.callbacks = {&dummy, &dummy, &dummy, &dummy, &dummy, &dummy, &dummy, &dummy}};
+struct port_callbacks_s port4_cb = {.callbacks = {&dummy, &dummy, &dummy, &dummy, &dummy, &dummy, &dummy, &dummy}};
 
 const struct port_s port1_v  = {&P1DIR, &P1OUT, &P1REN, &P1IN, &P1IE, &P1IES, &P1IFG, &P1SEL0, &P1SEL1, &P1SELC, &port1_cb}, * port1 =  &port1_v;
 const struct port_s port2_v  = {&P2DIR, &P2OUT, &P2REN, &P2IN, &P2IE, &P2IES, &P2IFG, &P2SEL0, &P2SEL1, &P2SELC, &port2_cb}, * port2 =  &port2_v;
@@ -51,11 +53,19 @@ const uint8_t pinBits[8] =  { (0x1<<0),  (0x1<<1),  (0x1<<2),  (0x1<<3),  (0x1<<
 //Looks up and calls the specific callback for a given pin.
 //This is really too much work for an ISR, but it's mighty convenient
 static void ISR_HANDLER(const struct port_s * port ) {
-    uint8_t ifg = *(port->ifg_addr); //get interrupt flags for this port
+    uint8_t ifg = *(port->ifg_addr) & *(port->ie_addr); //get interrupt flags for this port, ignoring pins without interrupts enabled
     uint8_t i=0;
     for (; i<8; i++) { //check all 8 flags for this port
         if (ifg & 0x1) { //check if flag is set
+#if ARC_MSP_CONFIG_ARCOS_EVENTS
+            if (port->callbacks->events[i] != NULL) {
+                arcos_event_set(port->callbacks->events[i], port->callbacks->event_bits[i]); //defer the work to the waiting process
+            } else {
+                (port->callbacks->callbacks[i])(); //call callback
+            }
+#else
             (port->callbacks->callbacks[i])(); //call callback
+#endif
         }
         ifg = ifg >> 1; //get next flag
     }
@@ -65,19 +75,27 @@ static void ISR_HANDLER(const struct port_s * port ) {
 //Interrupt Service Routines for each port
 __attribute__ ((interrupt(PORT1_VECTOR)))
 static void Port_1(void) {
+    arcos_trace_isr_enter(1);
     ISR_HANDLER(port1);
+    arcos_trace_isr_exit(1);
 }
 __attribute__ ((interrupt(PORT2_VECTOR)))
 static void Port_2(void) {
+    arcos_trace_isr_enter(2);
     ISR_HANDLER(port2);
+    arcos_trace_isr_exit(2);
 }
 __attribute__ ((interrupt(PORT3_VECTOR)))
 static void Port_3(void) {
+    arcos_trace_isr_enter(3);
     ISR_HANDLER(port3);
+    arcos_trace_isr_exit(3);
 }
 __attribute__ ((interrupt(PORT4_VECTOR)))
 static void Port_4(void) {
+    arcos_trace_isr_enter(4);
     ISR_HANDLER(port4);
+    arcos_trace_isr_exit(4);
 }
 
 void dummy(void){
@@ -92,8 +110,22 @@ void pinInterrupt(const struct portPin_s * portPin, uint8_t interruptEnable, uin
     *(portPin->port->ies_addr) = (*(portPin->port->ies_addr) & pinMasks[portPin->pin]) | (pinBits[portPin->pin] * edge); //configure trigger edge
     *(portPin->port->ifg_addr) = (*(portPin->port->ifg_addr) & pinMasks[portPin->pin]); //clear ifg, just in case
     portPin->port->callbacks->callbacks[portPin->pin] = isr_callback; //store callback
+#if ARC_MSP_CONFIG_ARCOS_EVENTS
+    portPin->port->callbacks->events[portPin->pin] = NULL; //a callback replaces any bound event
+#endif
     //_enable_interrupt();
 }
+#if ARC_MSP_CONFIG_ARCOS_EVENTS
+//configures an interrupt for a specific pin that sets bits on an ARCOS event, optionally enabling it
+void pinInterruptEvent(const struct portPin_s * portPin, uint8_t interruptEnable, uint8_t edge, struct arcos_event_s * event, uint16_t bits) {
+    if (portPin->port->callbacks == NULL) return; //early return if port is not interrupt capable
+    portPin->port->callbacks->event_bits[portPin->pin] = bits; //bind the event before the interrupt can be enabled
+    portPin->port->callbacks->events[portPin->pin] = event;
+    *(portPin->port->ie_addr) = (*(portPin->port->ie_addr) & pinMasks[portPin->pin]) | (pinBits[portPin->pin] * interruptEnable); //optionally enable interrupt
+    *(portPin->port->ies_addr) = (*(portPin->port->ies_addr) & pinMasks[portPin->pin]) | (pinBits[portPin->pin] * edge); //configure trigger edge
+    *(portPin->port->ifg_addr) = (*(portPin->port->ifg_addr) & pinMasks[portPin->pin]); //clear ifg, just in case
+}
+#endif
 //convenience function to configure interrupts on a group of pins
 void group_pinInterrupt(const struct portPin_s (*portPins)[], const uint16_t count, uint8_t interruptEnable, uint8_t edge, void (*isr_callback)(void)) {
     uint8_t i=0;
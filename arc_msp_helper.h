@@ -6,6 +6,8 @@ Updated 2020/12
 #ifndef ARC_MSP_HELPER_GUARD
 #define ARC_MSP_HELPER_GUARD
 
+#include "arc_msp_config.h"
+
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -75,8 +77,15 @@ Updated 2020/12
 
     //stores the ISR callback for each pin on interrupt-enabled ports
     //not included in port_s struct so that ports that do not support interrupts do not waste memory
+    #if ARC_MSP_CONFIG_ARCOS_EVENTS
+        struct arcos_event_s; //defined in arcos.h
+    #endif
     struct port_callbacks_s {
         void (*callbacks[8])(void);
+    #if ARC_MSP_CONFIG_ARCOS_EVENTS
+        struct arcos_event_s * events[8]; //if set, the ISR sets event_bits on this event instead of calling the callback
+        uint16_t event_bits[8];
+    #endif
     };
     extern struct port_callbacks_s port1_cb;
     extern struct port_callbacks_s port2_cb;
@@ -136,6 +145,11 @@ Updated 2020/12
 #ifdef ARC_MSP_USE_GPIO
     //configures an interrupt for a specific pin and optionally enables it
     void pinInterrupt(const struct portPin_s * portPin, uint8_t interruptEnable, uint8_t edge, void (*isr_callback)(void));
+    #if ARC_MSP_CONFIG_ARCOS_EVENTS
+        //configures an interrupt for a specific pin that sets bits on an ARCOS event, optionally enabling it
+        //the ISR only sets the flags, all work runs in the process waiting on the event
+        void pinInterruptEvent(const struct portPin_s * portPin, uint8_t interruptEnable, uint8_t edge, struct arcos_event_s * event, uint16_t bits);
+    #endif
     //convenience function to configure interrupts on a group of pins
     void group_pinInterrupt(const struct portPin_s (*portPins)[], const uint16_t count, uint8_t interruptEnable, uint8_t edge, void (*isr_callback)(void));
     //convenience function to enable interrupt on a single pin
@@ -5,9 +5,19 @@ Updated 2020/12
 
 #include "arcos.h"
 
-#include <msp430.h>
+#ifdef ARCOS_PORT_POSIX
+    #include <signal.h>
+    #include <stdio.h>
+    #include <stdlib.h>
+    #include <sys/time.h>
+    #include <time.h>
+#else
+    #include <msp430.h>
+#endif
 #include <string.h>
+#include <stddef.h>
 
+#ifndef ARCOS_PORT_POSIX
 //FOR FUTURE USE
 //provides a valid ISR stub for all interrupt sources
 __attribute__ ((interrupt(AES256_VECTOR)))
@@ -21,18 +31,14 @@ __attribute__ ((interrupt(PORT2_VECTOR)))
 __attribute__ ((interrupt(TIMER2_A1_VECTOR)))
 __attribute__ ((interrupt(TIMER2_A0_VECTOR)))
 __attribute__ ((interrupt(PORT1_VECTOR)))
-__attribute__ ((interrupt(TIMER1_A1_VECTOR)))
-__attribute__ ((interrupt(TIMER1_A0_VECTOR)))
-__attribute__ ((interrupt(DMA_VECTOR)))
 __attribute__ ((interrupt(USCI_B1_VECTOR)))
 __attribute__ ((interrupt(USCI_A1_VECTOR)))
 __attribute__ ((interrupt(TIMER0_A1_VECTOR)))
-__attribute__ ((interrupt(TIMER0_A0_VECTOR)))
 __attribute__ ((interrupt(ADC12_VECTOR)))
 __attribute__ ((interrupt(USCI_B0_VECTOR)))
 __attribute__ ((interrupt(USCI_A0_VECTOR)))
 __attribute__ ((interrupt(ESCAN_IF_VECTOR)))
-//__attribute__ ((interrupt(WDT_VECTOR)))
+__attribute__ ((interrupt(WDT_VECTOR)))
 __attribute__ ((interrupt(TIMER0_B1_VECTOR)))
 __attribute__ ((interrupt(TIMER0_B0_VECTOR)))
 __attribute__ ((interrupt(COMP_E_VECTOR)))
@@ -42,21 +48,380 @@ __attribute__ ((interrupt))
 static void arcos_isr_stub(void) {
     return;
 }
+#endif
+
+//converts microseconds to a Timer0_A CCR0 value, the timer counts SMCLK in up mode so one extra count is added by the hardware
+#define ARCOS_SLICE_COUNTS(us) (((((uint32_t)(us)) * (ARCOS_CONFIG_CLOCK_FREQ_SMCLK / 1000)) / 1000) - 1)
+
+//stops the compiler from moving memory accesses across this point, the MSP430 executes them in order so no instruction is needed
+#define ARCOS_COMPILER_BARRIER() __asm volatile ("" ::: "memory")
+
+//stack painting patterns, the guard word sits at the lowest address of every checked stack
+#define ARCOS_STACK_PAINT (0xA5A5)
+#define ARCOS_STACK_GUARD (0xDEAD)
+
+//bytes used to save R4-R15, PUSHM.A saves 4 bytes per register and PUSHM.W saves 2
+#if ARCOS_CONFIG_CONTEXT_16BIT == 2
+    #define ARCOS_CONTEXT_REG_SIZE (2 * 12)
+#else
+    #define ARCOS_CONTEXT_REG_SIZE (4 * 12)
+#endif
+
+#ifdef ARCOS_PORT_POSIX
+    //smallest stack the host port accepts, a signal frame alone takes a few KB
+    #define ARCOS_PROC_FRAME_SIZE (8192)
+#else
+    //bytes a new process stack needs for its initial context, return address + PC + SR + 12 registers
+    #define ARCOS_PROC_FRAME_SIZE (4 + 2 + 2 + ARCOS_CONTEXT_REG_SIZE)
+#endif
+
+//alignment of pool allocated stacks and of the free block headers inside the pools
+#define ARCOS_STACK_ALIGN (sizeof(arcos_addr_t))
+
+//placement of the scheduler hot paths, sections are placed by arcos_sections.ld
+//the host port has a single kind of memory, so nothing is moved there
+#if (ARCOS_CONFIG_PLACE_SRAM >= 1) && !defined(ARCOS_PORT_POSIX)
+    #define ARCOS_PLACE_KERNEL_SRAM (1)
+#else
+    #define ARCOS_PLACE_KERNEL_SRAM (0)
+#endif
+#if (ARCOS_CONFIG_PLACE_SRAM == 2) && !defined(ARCOS_PORT_POSIX)
+    #define ARCOS_SRAM_CODE __attribute__ ((section(".arcos_ramfunc"))) //copied from FRAM to SRAM by arcos_init()
+#else
+    #define ARCOS_SRAM_CODE
+#endif
+
+//number of stack pools, ARCOS_STACK_POOL_FRAM and ARCOS_STACK_POOL_SRAM
+#define ARCOS_STACK_POOL_COUNT (2)
+
+//number of clock profiles, the fastest one is ARCOS_CLOCK_24MHZ
+#define ARCOS_CLOCK_PROFILE_COUNT (ARCOS_CLOCK_24MHZ + 1)
+
+//number of ready levels, and number of 16-bit words needed to hold one bit per level
+#define ARCOS_PRIO_LEVELS (256 >> ARCOS_CONFIG_PRIO_SHIFT)
+#define ARCOS_PRIO_GROUPS ((ARCOS_PRIO_LEVELS + 15) / 16)
+
+#if ARCOS_CONFIG_AGING_MS > 0
+    //ticks a ready process waits for each level it is raised, so the lowest level reaches level 0 after ARCOS_CONFIG_AGING_MS
+    #define ARCOS_AGING_STEP (ARCOS_MS_TO_TICKS(ARCOS_CONFIG_AGING_MS) / ARCOS_PRIO_LEVELS)
+    #if ((ARCOS_CONFIG_AGING_MS * (ARCOS_CONFIG_TICK_HZ / 8)) / 125) < ARCOS_PRIO_LEVELS
+        #error ARCOS_CONFIG_AGING_MS is too short for the number of priority levels
+    #endif
+#endif
 
 struct arcos_kernel_s {
     uint16_t SP;
-    uint8_t stack[ARCOS_CONFIG_KERNEL_SIZE_STACK];
     struct arcos_proc_s * proc_current;
+    struct arcos_proc_s * proc_handoff; //process named by arcos_proc_yield_to(), dispatched next instead of the ready scan
+    uint16_t slice; //timeslice of proc_current as a Timer0_A CCR0 value, its quantum unless it was handed the rest of another slice
+    uint16_t slice_handoff; //rest of the donor's slice, given to proc_handoff
     uint16_t proc_count;
-    struct arcos_proc_s * proc_list[ARCOS_CONFIG_PROC_COUNT_MAX];
-    uint8_t proc_stack[ARCOS_CONFIG_PROC_COUNT_MAX][ARCOS_CONFIG_PROC_STACK_SIZE_MAX];
+    uint8_t proc_id_next; //id given to the last created process
+#if ARCOS_CONFIG_STATS
+    uint32_t run_stamp; //kernel time when the current process was dispatched or the kernel went idle
+    uint32_t idle_ticks; //ticks spent with no process ready
+#endif
+    struct arcos_proc_s * proc_list[ARCOS_CONFIG_PROC_COUNT_MAX]; //every created process, unordered
+    uint16_t ready_groups; //bit n is set if ready_levels[n] is not zero
+    uint16_t ready_levels[ARCOS_PRIO_GROUPS]; //bit n of word g is set if ready_list[(g*16)+n] is not empty
+    struct arcos_proc_s * ready_list[ARCOS_PRIO_LEVELS]; //circular list of ready processes for each level, head runs next
+    struct arcos_proc_s * sleep_list; //delta queue of sleeping processes, each wake_delta is relative to the entry before it
+    uint32_t sleep_stamp; //tick that the wake_delta of the head of sleep_list is relative to
+    uint16_t time_hi; //upper 16 bits of the kernel time, incremented by the Timer1_A overflow interrupt
+    uint16_t time_wraps; //times the 32-bit kernel time has wrapped, keeps arcos_time_now() continuous across the wrap
+    arcos_addr_t stack_free[ARCOS_STACK_POOL_COUNT]; //address of the first free block of each stack pool, 0 if the pool is full
+    uint8_t clock_profile; //current ARCOS_CLOCK_ profile
+    uint8_t clock_request; //profile last set by arcos_clock_set_profile(), clock_profile is faster while a hold needs it
+    uint8_t clock_holds[ARCOS_CLOCK_PROFILE_COUNT]; //drivers that need MCLK at least as fast as each profile, see arcos_clock_hold()
+    uint8_t lpm0_holds; //drivers that need SMCLK while idle, the kernel idles in LPM0 instead of LPM3 while this is not 0
+    //the holds are released by ISRs while the kernel idles, so the checkpoint can hold stale ones, arcos_resume() clears them
+    struct arcos_clock_notifier_s * clock_notifiers; //drivers told about clock profile changes, most recently registered first
+#if ARCOS_CONFIG_CONTEXT_16BIT == 1
+    uint8_t context_16bit; //copy of proc_current->context_16bit, tested by the slice ISR before any register is saved
+#endif
+#if ARCOS_CONFIG_WARM_BOOT
+    bool boot_saved; //arcos_var_boot[boot_slot] matches the current state, cleared by the first change after the checkpoint
+    uint8_t boot_slot; //image of the last checkpoint, the next one is written to the other image
+    uint16_t boot_changes; //counts changes to the state a checkpoint copies, a checkpoint in progress is dropped if it moves
+#endif
+    uint8_t stack[ARCOS_CONFIG_KERNEL_SIZE_STACK]; //must be last, the warm boot checkpoint copies everything before it
 };
 
+#if ARCOS_PLACE_KERNEL_SRAM
+//stores all information that the kernel needs
+//in SRAM so the scheduler and kernel stack run without FRAM wait states, cleared by arcos_init()
+__attribute__ ((section(".arcos_sram")))
+static struct arcos_kernel_s arcos_var_kernel;
+
+//the kernel state, with its stack, and the SRAM stack pool share SRAM with the C startup stack, .data and .bss, and with
+//  the hot code when ARCOS_CONFIG_PLACE_SRAM is 2, which arcos_sections.ld checks, this only catches what cannot fit at all
+//ready_list takes 4 bytes per ready level, 1KB with ARCOS_CONFIG_PRIO_SHIFT 0, which leaves no room for the rest
+_Static_assert(sizeof(struct arcos_kernel_s) + ARCOS_CONFIG_STACK_POOL_SRAM_SIZE <= ARCOS_CONFIG_RAM_SIZE,
+    "kernel state and SRAM stack pool do not fit in SRAM, raise ARCOS_CONFIG_PRIO_SHIFT or shrink ARCOS_CONFIG_STACK_POOL_SRAM_SIZE");
+#else
 //stores all information that the kernel needs
 __attribute__ ((lower))
 __attribute__ ((persistent))
 static struct arcos_kernel_s arcos_var_kernel = {0};
+#endif
+
+//process stacks, too large for SRAM
+__attribute__ ((lower))
+__attribute__ ((persistent))
+static arcos_addr_t arcos_var_stack_pool_fram[ARCOS_CONFIG_STACK_POOL_FRAM_SIZE / sizeof(arcos_addr_t)] = {0};
+
+#if ARCOS_CONFIG_WARM_BOOT
+//marks a valid checkpoint, also changes with the layout of the image so an image from different firmware is rejected
+#define ARCOS_BOOT_MAGIC ((uint16_t) (0xA5C3 ^ sizeof(struct arcos_boot_s)))
+
+//checkpoint of everything the scheduler needs to resume, taken by arcos_os_boot_save() when the kernel goes idle
+//there are two images, a checkpoint is written to the one not holding the last checkpoint so a checkpoint cut short loses nothing
+//while idle every process has a complete context saved on its stack and FRAM stacks are not touched, so this, the FRAM stack pool
+//  and the persistent memory of the application are a consistent state to resume from
+struct arcos_boot_s {
+    uint16_t magic; //ARCOS_BOOT_MAGIC if the image is complete, written last
+    uint16_t crc; //CRC-16 of everything after it
+    uint32_t time; //kernel time of the checkpoint, the time base resumes from here
+    struct arcos_kernel_s kernel; //without the kernel stack
+    struct arcos_proc_s procs[ARCOS_CONFIG_PROC_COUNT_MAX]; //copy of each process in kernel.proc_list, in the same order
+#if ARCOS_CONFIG_STACK_POOL_SRAM_SIZE > 0
+    arcos_addr_t stack_pool_sram[ARCOS_CONFIG_STACK_POOL_SRAM_SIZE / sizeof(arcos_addr_t)]; //SRAM stacks do not survive a reset
+#endif
+};
+
+__attribute__ ((lower))
+__attribute__ ((persistent))
+static struct arcos_boot_s arcos_var_boot[2] = {{0}};
+#endif
+
+//bounds of the hot sections, defined by arcos_sections.ld
+//linking without arcos_sections.ld fails on these, so the hot paths cannot silently stay in FRAM
+#if ARCOS_PLACE_KERNEL_SRAM
+extern uint8_t __arcos_sram_start[];
+extern uint8_t __arcos_sram_end[];
+#endif
+#if ARCOS_CONFIG_PLACE_SRAM == 2 && !defined(ARCOS_PORT_POSIX)
+extern uint16_t __arcos_ramfunc_load[];
+extern uint16_t __arcos_ramfunc_start[];
+extern uint16_t __arcos_ramfunc_end[];
+
+//copies the hot paths from FRAM to SRAM, must run before any of them is called
+static void arcos_os_ramfunc_copy(void) {
+    uint16_t * src = __arcos_ramfunc_load;
+    for (uint16_t * dst = __arcos_ramfunc_start; dst < __arcos_ramfunc_end; dst++) {
+        *dst = *src++;
+    }
+}
+#endif
+
+#if ARCOS_CONFIG_STACK_POOL_SRAM_SIZE > 0
+//process stacks that need fast memory, placed in SRAM
+__attribute__ ((lower))
+static arcos_addr_t arcos_var_stack_pool_sram[ARCOS_CONFIG_STACK_POOL_SRAM_SIZE / sizeof(arcos_addr_t)];
+#endif
+
+#ifdef ARCOS_PORT_POSIX
+//state of the host port, SIGALRM plays the role of the timer interrupts and blocking it disables "interrupts"
+struct arcos_posix_s {
+    ucontext_t kernel; //context of arcos_start(), the kernel always runs there with SIGALRM blocked
+    sigset_t alarm; //set holding only SIGALRM
+    sigset_t none; //empty set, the signal mask of a running process
+    struct timespec epoch; //CLOCK_MONOTONIC at arcos_init(), kernel time counts from here
+    volatile sig_atomic_t switch_pending; //stands in for CCIFG of the timeslice timer
+    uint64_t slice_end; //microsecond the current timeslice ends, UINT64_MAX while idle
+    bool sleep_armed; //stands in for CCIE of the sleep compare
+    uint32_t sleep_tick; //stands in for the sleep compare value
+};
+static struct arcos_posix_s arcos_var_posix;
+#endif
+
+//trace event types, tools/arcos_trace.py must be kept in sync
+#define ARCOS_TRACE_BOOT        (0) //arcos_init() ran with id 0, or arcos_resume() restored a checkpoint with id 1, timestamps restart
+#define ARCOS_TRACE_DISPATCH    (1) //process id starts running
+#define ARCOS_TRACE_KERNEL      (2) //process id stopped running and the kernel was entered
+#define ARCOS_TRACE_IDLE        (3) //nothing is ready, the CPU sleeps
+#define ARCOS_TRACE_YIELD       (4)
+#define ARCOS_TRACE_CREATE      (5)
+#define ARCOS_TRACE_START       (6)
+#define ARCOS_TRACE_TERMINATE   (7)
+#define ARCOS_TRACE_BLOCK       (8)
+#define ARCOS_TRACE_WAKE        (9)
+#define ARCOS_TRACE_SLEEP       (10)
+#define ARCOS_TRACE_ISR_ENTER   (11) //id is the ISR id instead of a process id
+#define ARCOS_TRACE_ISR_EXIT    (12)
+#define ARCOS_TRACE_HANDOFF     (13) //id is the process the current slice was handed to
+#define ARCOS_TRACE_MISS        (14) //periodic process id finished a job late or skipped a release
+
+//ISR ids used by the kernel, applications should use ids below these
+#define ARCOS_TRACE_ISR_SLEEP     (0xFE)
+#define ARCOS_TRACE_ISR_OVERFLOW  (0xFF)
+
+#if ARCOS_CONFIG_TRACE_SIZE > 0
+//one trace event, time is the Timer1_A count when it was recorded
+struct arcos_trace_record_s {
+    uint16_t time;
+    uint8_t event;
+    uint8_t id;
+};
+
+//ring buffer of trace events, persistent so the events leading up to a reset can be read afterwards
+//dump it with a debugger and decode it with tools/arcos_trace.py
+struct arcos_trace_s {
+    uint16_t head; //total number of records written, wraps
+    struct arcos_trace_record_s records[ARCOS_CONFIG_TRACE_SIZE];
+};
+
+__attribute__ ((lower))
+__attribute__ ((persistent))
+static struct arcos_trace_s arcos_var_trace = {0};
+#endif
+
+//bit and lowest-set-bit LUTs as a performance optimization, shifting is relatively slow on the MSP430
+__attribute__ ((lower))
+static const uint16_t arcos_os_bit_LUT[16] = {
+    0x0001, 0x0002, 0x0004, 0x0008, 0x0010, 0x0020, 0x0040, 0x0080,
+    0x0100, 0x0200, 0x0400, 0x0800, 0x1000, 0x2000, 0x4000, 0x8000
+};
+__attribute__ ((lower))
+static const uint8_t arcos_os_lsb_LUT[256] = {
+    0, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+    4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+    5, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+    4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+    6, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+    4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+    5, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+    4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+    7, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+    4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+    5, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+    4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+    6, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+    4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+    5, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+    4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0
+};
+
+#if ARCOS_CONFIG_WARM_BOOT
+//drops the checkpoint once the state it describes changes
+//must be called with interrupts disabled
+static inline void arcos_os_boot_invalidate(void) {
+    arcos_var_kernel.boot_changes++;
+    if (arcos_var_kernel.boot_saved) {
+        arcos_var_boot[arcos_var_kernel.boot_slot].magic = 0;
+        arcos_var_kernel.boot_saved = false;
+    }
+}
+#endif
+
+//returns the index of the lowest set bit, bits must not be zero
+static inline uint8_t arcos_os_lsb(uint16_t bits) {
+    if (bits & 0x00FF) {
+        return arcos_os_lsb_LUT[bits & 0x00FF];
+    }
+    return 8 + arcos_os_lsb_LUT[bits >> 8];
+}
+
+#if ARCOS_CONFIG_PERIODIC
+//returns true if a must run before b when both are ready on the same level
+//periodic processes run before the others, ordered by relative deadline, or absolute deadline under EDF, ties keep their order
+static inline bool arcos_os_ready_before(struct arcos_proc_s * a, struct arcos_proc_s * b) {
+    if (a->periodic.period == 0) {
+        return false;
+    }
+    if (b->periodic.period == 0) {
+        return true;
+    }
+#if ARCOS_CONFIG_SCHED_EDF
+    return ((int32_t) (a->periodic.abs_deadline - b->periodic.abs_deadline)) < 0;
+#else
+    return a->periodic.deadline < b->periodic.deadline;
+#endif
+}
+#endif
+
+//appends a process to the tail of the ready list for its priority level
+//periodic processes are instead inserted in deadline order at the front of the level
+//must be called with interrupts disabled
+static inline void arcos_os_ready_insert(struct arcos_proc_s * handle) {
+#if ARCOS_CONFIG_WARM_BOOT
+    arcos_os_boot_invalidate(); //a process becoming ready may already have left its wait queue, which is not part of the checkpoint
+#endif
+    uint8_t level = handle->priority >> ARCOS_CONFIG_PRIO_SHIFT;
+    struct arcos_proc_s * head = arcos_var_kernel.ready_list[level];
+    if (head == NULL) { //first process on this level, mark the level as ready
+        handle->next = handle;
+        handle->prev = handle;
+        arcos_var_kernel.ready_list[level] = handle;
+        arcos_var_kernel.ready_levels[level >> 4] |= arcos_os_bit_LUT[level & 0xF];
+        arcos_var_kernel.ready_groups |= arcos_os_bit_LUT[level >> 4];
+        return;
+    }
+    struct arcos_proc_s * entry = head; //insert before this entry, the head is after the tail of a circular list
+#if ARCOS_CONFIG_PERIODIC
+    if (handle->periodic.period != 0) { //walk the periodic processes at the front, few enough that a linear search is fine
+        while (!arcos_os_ready_before(handle, entry)) {
+            entry = entry->next;
+            if (entry == head) {
+                break;
+            }
+        }
+        if (arcos_os_ready_before(handle, head)) {
+            arcos_var_kernel.ready_list[level] = handle;
+        }
+    }
+#endif
+    handle->next = entry;
+    handle->prev = entry->prev;
+    entry->prev->next = handle;
+    entry->prev = handle;
+}
+
+//removes a process from the ready list for its priority level
+//must be called with interrupts disabled
+static inline void arcos_os_ready_remove(struct arcos_proc_s * handle) {
+    uint8_t level = handle->priority >> ARCOS_CONFIG_PRIO_SHIFT;
+    if (handle->next == handle) { //last process on this level, mark the level as empty
+        arcos_var_kernel.ready_list[level] = NULL;
+        arcos_var_kernel.ready_levels[level >> 4] &= ~arcos_os_bit_LUT[level & 0xF];
+        if (arcos_var_kernel.ready_levels[level >> 4] == 0) {
+            arcos_var_kernel.ready_groups &= ~arcos_os_bit_LUT[level >> 4];
+        }
+    } else {
+        handle->prev->next = handle->next;
+        handle->next->prev = handle->prev;
+        if (arcos_var_kernel.ready_list[level] == handle) {
+            arcos_var_kernel.ready_list[level] = handle->next;
+        }
+    }
+}
 
+//returns the highest priority level with a ready process, ready_groups must not be zero
+//must be called with interrupts disabled
+static inline uint8_t arcos_os_ready_level(void) {
+    uint8_t group = arcos_os_lsb(arcos_var_kernel.ready_groups);
+    return (group << 4) + arcos_os_lsb(arcos_var_kernel.ready_levels[group]);
+}
+
+//returns the next process to run from the highest priority ready level, or NULL if nothing is ready
+//the level is rotated so processes with the same priority take turns
+//must be called with interrupts disabled
+static inline struct arcos_proc_s * arcos_os_ready_next(void) {
+    if (arcos_var_kernel.ready_groups == 0) {
+        return NULL;
+    }
+    uint8_t level = arcos_os_ready_level();
+    struct arcos_proc_s * handle = arcos_var_kernel.ready_list[level];
+#if ARCOS_CONFIG_PERIODIC
+    if (handle->periodic.period != 0) {
+        return handle; //periodic processes keep the head of their level until the job finishes
+    }
+#endif
+    arcos_var_kernel.ready_list[level] = handle->next; //move this process to the back of its level
+    return handle;
+}
+
+#ifndef ARCOS_PORT_POSIX
 //These functions are simply intended to increase code readability
 //  and reduce potential mistakes. They have the inline specifier to hint that they
 //  should probably not result in a true function call.
@@ -76,213 +441,2065 @@ static inline void WDT_start(void) {
     WDTCTL = WDTPW | (WDTCTL_L & (~WDTHOLD));
 }
 
-//Triggers a reset and PUC, hard restarting the entire MCU
-__attribute__ ((used))
-__attribute__ ((noreturn))
-__attribute__ ((naked))
-static void arcos_os_pwr_reset(void) {
-    WDTCTL = WDTPW | WDTSSEL__ACLK | WDTIS__64; //sets WDT to watchdog mode
-    WDTCTL = 0xFF | WDTSSEL__ACLK | WDTIS__64; //intentionally writes incorrect password to WDTCTL to trigger a hard reset
-    while(true); //wait
+//disables interrupts and returns the previous GIE state, pass it to arcos_os_critical_exit()
+static inline uint16_t arcos_os_critical_enter(void) {
+    uint16_t GIE_BACKUP = _get_SR_register() & GIE; //store GIE
+    __asm(" DINT \n NOP \n"); //disable interrupts
+    return GIE_BACKUP;
+}
+static inline void arcos_os_critical_exit(uint16_t GIE_BACKUP) {
+    __asm(" BIS.B %0, SR \n NOP \n"::"r"(GIE_BACKUP)); //restore GIE
 }
 
-//simple priority round-robin scheduling
-//WARNING: high priority tasks can starve lower priority tasks
-__attribute__ ((noreturn))
-__attribute__ ((naked))
-static void arcos_os_schedule(void) {
-    if (arcos_var_kernel.proc_count > 0) { //are there any processes left?
-        for (uint8_t i=0; i<arcos_var_kernel.proc_count; i++) { //read through the list of processes
-            if (arcos_var_kernel.proc_list[i]->status == PROC_STATE_READY) { //get the first ready process, this will be the highest priority one since list is sorted
-                arcos_var_kernel.proc_current = arcos_var_kernel.proc_list[i]; //set as current process
-                uint8_t ii = i+1;
-                //move this process to the back of the list of processes with the same priority
-                for (; (arcos_var_kernel.proc_list[ii]->priority == arcos_var_kernel.proc_current->priority) && (ii < arcos_var_kernel.proc_count); ii++) {
-                    arcos_var_kernel.proc_list[ii-1] = arcos_var_kernel.proc_list[ii];
-                }
-                arcos_var_kernel.proc_list[ii-1] = arcos_var_kernel.proc_current;
-                break;
-            }
-        }
-    } else {
-        arcos_os_pwr_reset(); //There are no more processes left to schedule. This is assumed to be a mistake, so restart the MCU
+//requests a context switch by setting the timeslice interrupt flag
+//the switch happens as soon as interrupts are enabled, so from an ISR it happens right after the ISR returns
+static inline void arcos_os_switch_request(void) {
+    TA0CCTL0 |= CCIFG; //single BIS, cannot be torn by an interrupt
+}
+#else
+//blocks SIGALRM and returns 1 if it was unblocked, pass it to arcos_os_critical_exit()
+static inline uint16_t arcos_os_critical_enter(void) {
+    sigset_t old;
+    sigprocmask(SIG_BLOCK, &arcos_var_posix.alarm, &old);
+    return !sigismember(&old, SIGALRM);
+}
+static inline void arcos_os_critical_exit(uint16_t GIE_BACKUP) {
+    if (GIE_BACKUP) {
+        sigprocmask(SIG_UNBLOCK, &arcos_var_posix.alarm, NULL);
     }
-
-    __asm(" BIC.B %0, %1\n"::"r"(WDTIFG), "r"(SFRIFG1_L)); //clear WDTIFG using BIC.B, as recommended in User's Guide page 74
-    WDT_restart(); //restart the WDT
-    //_enable_interrupts(); //not needed because RETI will restore SR and enable interrupts
-    arcos_var_kernel.proc_current->status = PROC_STATE_RUNNING; //mark the selected process as running
-    __set_SP_register(arcos_var_kernel.proc_current->SP); //change the stack pointer to the process
-    __asm(" POPM.A #12,R15\n"); //restore context
-    __asm(" RETI\n"); //return control flow to process
 }
 
-//kernel entry point after startup, process pre-emption, etc
-__attribute__ ((noreturn))
-__attribute__ ((naked))
-static void arcos_os_run(void) {
-    WDT_stop(); //stop the WDT
-    //other features added here
-    arcos_os_schedule(); //schedule the next process
+//requests a context switch, the signal stays pending while SIGALRM is blocked just like CCIFG while GIE is clear
+static inline void arcos_os_switch_request(void) {
+    arcos_var_posix.switch_pending = 1;
+    raise(SIGALRM);
 }
+#endif
 
-//ISR called after timeslice expires
-//saves context of current process and returns control flow to kernel
-__attribute__ ((interrupt(WDT_VECTOR)))
-__attribute__ ((naked))
-static void arcos_os_isr_timeout_slice(void) {
-    //PC and SR are already pushed by the interrupt
-    //Pushes R4-R15 to the stack, saving all 20 bits. Each register uses 4 bytes, so total size is 48bytes
-    __asm(" PUSHM.A #12,R15\n");
-    //At this point, process context is saved except SP
-    uint16_t proc_SP = __get_SP_register(); //get SP
-    arcos_var_kernel.proc_current->SP = proc_SP; //save process SP
-    arcos_var_kernel.proc_current->status = PROC_STATE_READY; //mark process as ready to run
+//requests a context switch if a ready process has a higher priority level than the current process
+//or, on the same level, a periodic process was inserted ahead of it
+//while the kernel is idle any ready process is enough, the switch request is what wakes the scheduler
+//must be called with interrupts disabled
+static inline void arcos_os_preempt_check(void) {
+    if (arcos_var_kernel.ready_groups == 0) {
+        return;
+    }
+    if (arcos_var_kernel.proc_current == NULL) {
+        arcos_os_switch_request();
+        return;
+    }
+    uint8_t level = arcos_os_ready_level();
+    uint8_t current = arcos_var_kernel.proc_current->priority >> ARCOS_CONFIG_PRIO_SHIFT;
+    if (level < current) {
+        arcos_os_switch_request();
+    }
+#if ARCOS_CONFIG_PERIODIC
+    else if (level == current) {
+        struct arcos_proc_s * head = arcos_var_kernel.ready_list[level];
+        if ((head != arcos_var_kernel.proc_current) && (head->periodic.period != 0)) {
+            arcos_os_switch_request();
+        }
+    }
+#endif
+}
 
-    __set_SP_register(arcos_var_kernel.SP); //change stack pointer to kernel
-    __asm(" PUSHX.A %0\n"::"r"(&arcos_os_run)); //push address of arcos_os_run() to stack
-    __asm(" RETA\n"); //pop address and return control flow to kernel
+#ifndef ARCOS_PORT_POSIX
+//reads the Timer1_A counter
+//the timer is clocked by ACLK, asynchronous to MCLK, so it is read until two reads agree as recommended in the User's Guide
+static inline uint16_t arcos_os_timer_read(void) {
+    uint16_t t0;
+    uint16_t t1 = TA1R;
+    do {
+        t0 = t1;
+        t1 = TA1R;
+    } while (t0 != t1);
+    return t1;
 }
 
-//sorts processes by priority
-//very crappy sorting algorithm
-static inline void arcos_os_proc_sort(void) {
-    for (uint8_t i=0; i<arcos_var_kernel.proc_count; i++) {
-        struct arcos_proc_s * temp = arcos_var_kernel.proc_list[i];
-        int16_t ii = i - 1;
-        for (; ii >= 0 && arcos_var_kernel.proc_list[ii]->priority > temp->priority; ii--) {
-            arcos_var_kernel.proc_list[ii+1] = arcos_var_kernel.proc_list[ii];
-        }
-        arcos_var_kernel.proc_list[ii+1] = temp;
+//returns the 32-bit kernel time in ticks
+//must be called with interrupts disabled
+static inline uint32_t arcos_os_time(void) {
+    uint16_t hi = arcos_var_kernel.time_hi;
+    uint16_t lo = arcos_os_timer_read();
+    if ((TA1CTL & TAIFG) && (lo < 0x8000)) { //counter wrapped but the overflow ISR has not run yet
+        hi++;
     }
+    return (((uint32_t) hi) << 16) | lo;
+}
+#else
+//returns the microseconds since arcos_init()
+static inline uint64_t arcos_os_posix_us(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t) (now.tv_sec - arcos_var_posix.epoch.tv_sec) * 1000000) + (now.tv_nsec / 1000) - (arcos_var_posix.epoch.tv_nsec / 1000);
 }
 
-//removes process from process list
-void arcos_proc_terminate(struct arcos_proc_s * handle) {
-    uint16_t GIE_BACKUP = _get_SR_register() & GIE; //store GIE
-    __asm(" DINT \n NOP \n"); //disable interrupts
+//returns the 32-bit kernel time in ticks
+static inline uint32_t arcos_os_time(void) {
+    return (uint32_t) ((arcos_os_posix_us() * ARCOS_CONFIG_TICK_HZ) / 1000000);
+}
 
-    handle->status = PROC_STATE_TERMINATED;
+//returns the low 16 bits of the kernel time, the host equivalent of reading the Timer1_A counter
+static inline uint16_t arcos_os_timer_read(void) {
+    return (uint16_t) arcos_os_time();
+}
+#endif
 
-    //finds process index from pointer
-    for (uint8_t i=0; i<arcos_var_kernel.proc_count; i++) {
-        if (arcos_var_kernel.proc_list[i] == handle) {
-            arcos_var_kernel.proc_list[i] = arcos_var_kernel.proc_list[arcos_var_kernel.proc_count-1];
-        }
+//appends a record to the trace ring buffer, overwriting the oldest once it is full
+//costs one Timer1_A read and three stores, so it can stay enabled
+//must be called with interrupts disabled
+static inline void arcos_os_trace(uint8_t event, uint8_t id) {
+#if ARCOS_CONFIG_TRACE_SIZE > 0
+    struct arcos_trace_record_s * record = &arcos_var_trace.records[arcos_var_trace.head & (ARCOS_CONFIG_TRACE_SIZE - 1)];
+    arcos_var_trace.head++;
+    record->time = arcos_os_timer_read();
+    record->event = event;
+    record->id = id;
+#else
+    (void) event;
+    (void) id;
+#endif
+}
+
+//inserts a process into a wait queue, highest priority first and FIFO within a priority
+//blocked processes are not on a ready list, so the next pointer is reused for the queue
+//must be called with interrupts disabled
+static inline void arcos_os_waitq_insert(struct arcos_proc_s ** queue, struct arcos_proc_s * handle) {
+    handle->wait_queue = queue;
+    while ((*queue != NULL) && ((*queue)->priority <= handle->priority)) {
+        queue = &((*queue)->next);
     }
-    arcos_var_kernel.proc_count--;
-    arcos_os_proc_sort();
+    handle->next = *queue;
+    *queue = handle;
+}
 
-    __asm(" BIS.B %0, SR \n NOP \n"::"r"(GIE_BACKUP)); //restore GIE
+//removes a process from whichever wait queue it is on
+//must be called with interrupts disabled
+static inline void arcos_os_waitq_remove(struct arcos_proc_s * handle) {
+    struct arcos_proc_s ** queue = handle->wait_queue;
+    while (*queue != handle) {
+        queue = &((*queue)->next);
+    }
+    *queue = handle->next;
+    handle->wait_queue = NULL;
 }
 
-//runs when a process returns
-__attribute__ ((noreturn))
-__attribute__ ((naked))
-static void arcos_os_proc_return(void) {
-    _disable_interrupts();
+//removes and returns the highest priority process of a wait queue, the queue must not be empty
+//must be called with interrupts disabled
+static inline struct arcos_proc_s * arcos_os_waitq_pop(struct arcos_proc_s ** queue) {
+    struct arcos_proc_s * handle = *queue;
+    *queue = handle->next;
+    handle->wait_queue = NULL;
+    return handle;
+}
 
-    arcos_proc_terminate(arcos_var_kernel.proc_current);
+//blocks the current process on a wait queue and requests a context switch
+//the switch happens once the caller restores interrupts
+//must be called with interrupts disabled
+static inline void arcos_os_block(struct arcos_proc_s ** queue) {
+    struct arcos_proc_s * handle = arcos_var_kernel.proc_current;
+    arcos_os_trace(ARCOS_TRACE_BLOCK, handle->id);
+    arcos_os_ready_remove(handle);
+    handle->status = PROC_STATE_BLOCKED;
+    arcos_os_waitq_insert(queue, handle);
+    arcos_os_switch_request();
+}
 
-    __set_SP_register(arcos_var_kernel.SP);
-    __asm(" PUSHX.A %0\n"::"r"(&arcos_os_run));
-    __asm(" RETA\n");
+//makes a blocked process ready again, the caller is responsible for arcos_os_preempt_check()
+//must be called with interrupts disabled
+static inline void arcos_os_wake(struct arcos_proc_s * handle) {
+    arcos_os_trace(ARCOS_TRACE_WAKE, handle->id);
+#if ARCOS_CONFIG_AGING_MS > 0
+    handle->age_stamp = arcos_os_time(); //starts waiting now
+#endif
+    handle->status = PROC_STATE_READY;
+    arcos_os_ready_insert(handle);
 }
 
-//initial kernel entry point
-__attribute__ ((noreturn))
-__attribute__ ((naked))
-void arcos_start(void) {
-    _disable_interrupts();
+//wakes every sleeping process whose tick has been reached and makes the head delta relative to now
+//must be called with interrupts disabled
+ARCOS_SRAM_CODE
+static void arcos_os_sleep_advance(uint32_t now) {
+    uint32_t elapsed = now - arcos_var_kernel.sleep_stamp;
+    arcos_var_kernel.sleep_stamp = now;
+    struct arcos_proc_s * head = arcos_var_kernel.sleep_list;
+    while ((head != NULL) && (head->wake_delta <= elapsed)) {
+        elapsed -= head->wake_delta;
+        arcos_var_kernel.sleep_list = head->next;
+        arcos_os_wake(head);
+        head = arcos_var_kernel.sleep_list;
+    }
+    if (head != NULL) {
+        head->wake_delta -= elapsed;
+    }
+}
 
-    arcos_var_kernel.SP = (uint16_t) arcos_var_kernel.stack + sizeof(arcos_var_kernel.stack); //valid cast because we know the stacks are in the lower 64K of memory
+#ifndef ARCOS_PORT_POSIX
+//arms the Timer1_A CCR0 compare for the head of the sleep queue
+//wakeups a full counter period or more away are left to the overflow ISR, which calls this again at least once per period
+//the time left is compared in 32 bits, a 16-bit compare would take any wakeup more than half a period away as already passed
+//must be called with interrupts disabled
+ARCOS_SRAM_CODE
+static void arcos_os_sleep_program(void) {
+    struct arcos_proc_s * head = arcos_var_kernel.sleep_list;
+    if (head == NULL) {
+        TA1CCTL0 = 0;
+        return;
+    }
+    uint32_t target = arcos_var_kernel.sleep_stamp + head->wake_delta;
+    if ((int32_t) (target - arcos_os_time()) > 0xFFFF) {
+        TA1CCTL0 = 0;
+        return;
+    }
+    TA1CCR0 = (uint16_t) target;
+    TA1CCTL0 = CCIE;
+    if ((int32_t) (target - arcos_os_time()) <= 0) { //target passed while programming, the compare would not fire until the counter wraps
+        TA1CCTL0 = CCIE | CCIFG;
+    }
+}
+#else
+//the host has one interval timer, so it is armed for whichever comes first, the end of the timeslice or the sleep compare
+//must be called with SIGALRM blocked
+static void arcos_os_posix_timer_arm(void) {
+    uint64_t now = arcos_os_posix_us();
+    uint64_t end = arcos_var_posix.slice_end;
+    if (arcos_var_posix.sleep_armed) {
+        int32_t ticks = (int32_t) (arcos_var_posix.sleep_tick - arcos_os_time());
+        uint64_t wake = now + ((ticks > 0) ? ((((uint64_t) ticks) * 1000000) / ARCOS_CONFIG_TICK_HZ) + 1 : 0);
+        if (wake < end) {
+            end = wake;
+        }
+    }
+    struct itimerval timer = {0}; //one shot, all zero disarms
+    if (end != UINT64_MAX) {
+        uint64_t delay = (end > now) ? (end - now) : 1;
+        timer.it_value.tv_sec = delay / 1000000;
+        timer.it_value.tv_usec = delay % 1000000;
+    }
+    setitimer(ITIMER_REAL, &timer, NULL);
+}
 
-    __set_SP_register(arcos_var_kernel.SP);
-    __asm(" PUSHX.A %0\n"::"r"(&arcos_os_run));
-    __asm(" RETA\n");
+//arms the sleep compare for the head of the sleep queue
+//must be called with SIGALRM blocked
+static void arcos_os_sleep_program(void) {
+    struct arcos_proc_s * head = arcos_var_kernel.sleep_list;
+    arcos_var_posix.sleep_armed = (head != NULL);
+    if (head != NULL) {
+        arcos_var_posix.sleep_tick = arcos_var_kernel.sleep_stamp + head->wake_delta;
+    }
+    arcos_os_posix_timer_arm();
 }
+#endif
 
-//initial configuration of the core, sets up watchdog, clocks, timers, etc.
-//should be called immediately after boot
-void arcos_init(void) {
-    _disable_interrupts();
-    WDTCTL = WDTPW | WDTHOLD | WDTSSEL__ACLK | WDTTMSEL | WDTCNTCL | WDTIS__64; // Configure WDT
-    __asm(" BIC.B %0, %1\n"::"r"(WDTIFG), "r"(SFRIFG1_L)); //clear WDTIFG using BIC.B, as recommended in User's Guide page 74
-    SFRIE1 = WDTIE; //enable WDT interrupt
+//inserts the current process into the sleep queue, returns false if tick has already been reached
+//must be called with interrupts disabled
+static bool arcos_os_sleep(uint32_t tick) {
+    uint32_t now = arcos_os_time();
+    arcos_os_sleep_advance(now);
+    uint32_t delta = tick - now;
+    if ((delta == 0) || (delta & 0x80000000)) { //tick is now or in the past
+        return false;
+    }
 
-    FRCTL0 = FRCTLPW; //unlock FRCTL registers
-    FRCTL0_L = NWAITS_1; //set FRAM wait mode to 1 cycle (max FRAM access frequency is 8Mhz, we are setting CPU to 16Mhz)
-    FRCTL0_H = 0; //lock FRCTL registers
+    struct arcos_proc_s * handle = arcos_var_kernel.proc_current;
+    arcos_os_trace(ARCOS_TRACE_SLEEP, handle->id);
+    arcos_os_ready_remove(handle);
+    handle->status = PROC_STATE_SLEEPING;
 
-    CSCTL0 = CSKEY; //unlock CSCTLx registers
-    CSCTL1 = DCORSEL | DCOFSEL_4; //set DCO to 16Mhz
-    CSCTL2 = SELA__LFXTCLK | SELS__MODCLK | SELM__DCOCLK; //select clock sources
-    CSCTL3 = DIVA__1 | DIVS__2 | DIVM__1; //AUX 32768Hz, SM 2.5Mhz, M 16Mhz
-    //CSCTL2 = SELA__LFXTCLK | SELS__DCOCLK | SELM__DCOCLK; //select clock sources
-    //CSCTL3 = DIVA__1 | DIVS__1 | DIVM__1; //AUX 32768Hz, SM 16Mhz, M 16Mhz
-    //CSCTL3 = (CSCTL3 & ~((DIVS0 | DIVS1 | DIVS2) | (DIVM0 | DIVM1 | DIVM2))) | (DIVS_0 | DIVM_0); //set SMCLK and MCLK dividers to /1
-    CSCTL0_H = 0; //lock CSCTLx registers
+    //walk the queue, consuming the deltas of everything that wakes first
+    struct arcos_proc_s ** link = &arcos_var_kernel.sleep_list;
+    while ((*link != NULL) && ((*link)->wake_delta <= delta)) {
+        delta -= (*link)->wake_delta;
+        link = &((*link)->next);
+    }
+    handle->wake_delta = delta;
+    handle->next = *link;
+    *link = handle;
+    if (handle->next != NULL) {
+        handle->next->wake_delta -= delta;
+    }
 
-    //initialize unused ports to make compiler shut up
-    PADIR = 0x00;
-    PAOUT = 0x00;
-    PBDIR = 0x00;
-    PBOUT = 0x00;
-    PCDIR = 0x00;
-    PCOUT = 0x00;
-    PDDIR = 0x00;
-    PDOUT = 0x00;
-    PEDIR = 0x00;
-    PEOUT = 0x00;
+    arcos_os_sleep_program();
+    arcos_os_switch_request();
+    return true;
 }
 
-//yields timeslice to another process by immediately setting WDT interrupt flag
-inline void arcos_proc_yield(void) {
-    //SFRIFG1 = SFRIFG1 | WDTIFG;
-    __asm(" BIS.B %0, %1 \n NOP \n"::"i"(WDTIFG), "r"(SFRIFG1));
+//removes a sleeping process from the sleep queue, giving its delta to the entry after it
+//must be called with interrupts disabled
+static void arcos_os_sleep_remove(struct arcos_proc_s * handle) {
+    struct arcos_proc_s ** link = &arcos_var_kernel.sleep_list;
+    while (*link != handle) {
+        link = &((*link)->next);
+    }
+    *link = handle->next;
+    if (handle->next != NULL) {
+        handle->next->wake_delta += handle->wake_delta;
+    }
+    arcos_os_sleep_program();
 }
 
-//marks process as ready to run
-void arcos_proc_start(struct arcos_proc_s * handle) {
-    uint16_t GIE_BACKUP = _get_SR_register() & GIE; //store GIE
-    __asm(" DINT \n NOP \n"); //disable interrupts
+//header stored at the start of every free stack block
+//allocated blocks carry no header, their owner remembers the base and size
+struct arcos_stack_free_s {
+    arcos_addr_t size; //bytes in this block, including this header
+    arcos_addr_t next; //address of the next free block, 0 if last, blocks are kept in address order
+};
 
-    handle->status = PROC_STATE_READY; //TODO: add error checking
+//initializes a stack pool as one free block
+static void arcos_os_stack_pool_init(uint8_t pool, arcos_addr_t base, arcos_addr_t size) {
+    if (size < sizeof(struct arcos_stack_free_s)) {
+        arcos_var_kernel.stack_free[pool] = 0;
+        return;
+    }
+    struct arcos_stack_free_s * block = (struct arcos_stack_free_s *) base;
+    block->size = size;
+    block->next = 0;
+    arcos_var_kernel.stack_free[pool] = base;
+}
 
-    __asm(" BIS.B %0, SR \n NOP \n"::"r"(GIE_BACKUP)); //restore GIE
+//allocates a stack from a pool using first fit, returns the base address or 0 if nothing fits
+//size is rounded up and may be grown to swallow a remainder too small to stay free, the final size is written back
+//the block is cut from the top of a free block so the free header stays where it is
+//must be called with interrupts disabled
+static arcos_addr_t arcos_os_stack_alloc(uint8_t pool, uint16_t * size) {
+    arcos_addr_t want = (*size + ARCOS_STACK_ALIGN - 1) & ~(ARCOS_STACK_ALIGN - 1); //keep stacks and free headers aligned
+    arcos_addr_t * link = &arcos_var_kernel.stack_free[pool];
+    while (*link != 0) {
+        struct arcos_stack_free_s * block = (struct arcos_stack_free_s *) *link;
+        if (block->size >= want) {
+            if ((arcos_addr_t) (block->size - want) >= sizeof(struct arcos_stack_free_s)) { //split, the remainder stays free
+                block->size -= want;
+                *size = want;
+                return *link + block->size;
+            }
+            *size = block->size; //take the whole block
+            arcos_addr_t base = *link;
+            *link = block->next;
+            return base;
+        }
+        link = &block->next;
+    }
+    return 0;
 }
 
-/*
- * KNOWN ISSUE: Stack selection is based on number of processes, if a process ever terminates and a new one is created, stack pointers will then overlap
- */
-//0 is highest priority, 255 is lowest priority
-//initializes a arcos_proc_s struct and internal ARCOS variables
-void arcos_proc_create(struct arcos_proc_s * handle, void (*callback)(void), uint16_t SP, uint8_t priority) {
-    uint16_t GIE_BACKUP = _get_SR_register() & GIE; //store GIE
-    __asm(" DINT \n NOP \n"); //disable interrupts
+//returns a stack to its pool, merging it with free neighbours
+//must be called with interrupts disabled
+static void arcos_os_stack_free(uint8_t pool, arcos_addr_t base, arcos_addr_t size) {
+    arcos_addr_t prev = 0;
+    arcos_addr_t next = arcos_var_kernel.stack_free[pool];
+    while ((next != 0) && (next < base)) { //find the free blocks on either side
+        prev = next;
+        next = ((struct arcos_stack_free_s *) next)->next;
+    }
 
-    //initialize arcos_proc_s struct
-    handle->priority = priority;
-    handle->status = PROC_STATE_STOPPED;
-    if (SP) {
-        handle->SP = SP; //use specific stack pointer, if provided
+    struct arcos_stack_free_s * block = (struct arcos_stack_free_s *) base;
+    block->size = size;
+    block->next = next;
+    if ((next != 0) && ((base + size) == next)) { //merge with the following block
+        block->size += ((struct arcos_stack_free_s *) next)->size;
+        block->next = ((struct arcos_stack_free_s *) next)->next;
+    }
+
+    if (prev == 0) {
+        arcos_var_kernel.stack_free[pool] = base;
+    } else if ((prev + ((struct arcos_stack_free_s *) prev)->size) == base) { //merge into the preceding block
+        ((struct arcos_stack_free_s *) prev)->size += block->size;
+        ((struct arcos_stack_free_s *) prev)->next = block->next;
     } else {
-        handle->SP = (uint16_t) arcos_var_kernel.proc_stack[arcos_var_kernel.proc_count] + ARCOS_CONFIG_PROC_STACK_SIZE_MAX; //assign a process stack
+        ((struct arcos_stack_free_s *) prev)->next = base;
     }
-    handle->callback = callback;
+}
 
-    //manually manipulate process stack
-    handle->SP -= 4;
-    *((uintptr_t *)handle->SP) = (uintptr_t) &arcos_os_proc_return; //push return address of arcos_os_proc_return()
-    handle->SP -= 2;
-    *((uint16_t *)handle->SP) = ((uint32_t)callback) & 0x0000FFFF; //push process PC
-    handle->SP -= 2;
-    *((uint16_t *)handle->SP) = ((((uint32_t)callback) & 0x000F0000) >> 4) | (0b00001000 & 0x1FF); //push process SR
-    handle->SP -= 4 * 12; //push 12 empty registers
+//returns the stack of a terminated process to its pool, if it came from one
+//must be called with interrupts disabled, and never while running on that stack
+static inline void arcos_os_proc_stack_release(struct arcos_proc_s * handle) {
+    if (handle->stack_size != 0) {
+        arcos_os_stack_free(handle->stack_pool, handle->stack_base, handle->stack_size);
+        handle->stack_size = 0;
+    }
+}
 
-    arcos_var_kernel.proc_list[arcos_var_kernel.proc_count] = handle; //add pointer to process list
-    arcos_var_kernel.proc_count++;
-    arcos_os_proc_sort();
+//changes the effective priority of a process, keeping ready lists and wait queues ordered
+//must be called with interrupts disabled
+static void arcos_os_proc_set_priority(struct arcos_proc_s * handle, uint8_t priority) {
+#if ARCOS_CONFIG_AGING_MS > 0
+    handle->aged = false; //an explicit change, such as priority inheritance, replaces any aging boost
+#endif
+    if ((handle->status == PROC_STATE_READY) || (handle->status == PROC_STATE_RUNNING)) {
+        arcos_os_ready_remove(handle);
+        handle->priority = priority;
+        arcos_os_ready_insert(handle);
+    } else if (handle->wait_queue != NULL) {
+        struct arcos_proc_s ** queue = handle->wait_queue;
+        arcos_os_waitq_remove(handle);
+        handle->priority = priority;
+        arcos_os_waitq_insert(queue, handle);
+    } else {
+        handle->priority = priority;
+    }
+}
 
-    __asm(" BIS.B %0, SR \n NOP \n"::"r"(GIE_BACKUP)); //restore GIE
+//gives an unlocked mutex to a process
+//must be called with interrupts disabled
+static inline void arcos_os_mutex_acquire(struct arcos_mutex_s * mutex, struct arcos_proc_s * handle) {
+    mutex->owner = handle;
+    mutex->next_held = handle->mutex_held;
+    handle->mutex_held = mutex;
+}
+
+//recalculates the inherited priority of a process from the waiters of the mutexes it still holds
+//must be called with interrupts disabled
+static void arcos_os_mutex_inherit(struct arcos_proc_s * handle) {
+    uint8_t priority = handle->base_priority;
+    for (struct arcos_mutex_s * held_mutex = handle->mutex_held; held_mutex != NULL; held_mutex = held_mutex->next_held) {
+        if ((held_mutex->waiters != NULL) && (held_mutex->waiters->priority < priority)) {
+            priority = held_mutex->waiters->priority;
+        }
+    }
+    if (priority != handle->priority) {
+        arcos_os_proc_set_priority(handle, priority);
+    }
+}
+
+//takes a mutex from its owner and hands it to the highest priority waiting process, if any
+//the caller is responsible for arcos_os_mutex_inherit() on the old owner and for arcos_os_preempt_check()
+//must be called with interrupts disabled
+static void arcos_os_mutex_release(struct arcos_mutex_s * mutex) {
+    //remove from the list of held mutexes
+    struct arcos_mutex_s ** held = &mutex->owner->mutex_held;
+    while (*held != mutex) {
+        held = &((*held)->next_held);
+    }
+    *held = mutex->next_held;
+    mutex->next_held = NULL;
+    mutex->owner = NULL;
+
+    //hand over to the next waiter, which inherits from anything still waiting behind it
+    if (mutex->waiters != NULL) {
+        struct arcos_proc_s * next = arcos_os_waitq_pop(&mutex->waiters);
+        next->wait_mutex = NULL;
+        arcos_os_mutex_acquire(mutex, next);
+        if ((mutex->waiters != NULL) && (mutex->waiters->priority < next->priority)) {
+            next->priority = mutex->waiters->priority;
+        }
+        arcos_os_wake(next);
+    }
+}
+
+#ifndef ARCOS_PORT_POSIX
+//Triggers a reset and PUC, hard restarting the entire MCU
+__attribute__ ((used))
+__attribute__ ((noreturn))
+__attribute__ ((naked))
+static void arcos_os_pwr_reset(void) {
+    WDTCTL = WDTPW | WDTSSEL__ACLK | WDTIS__64; //sets WDT to watchdog mode
+    WDTCTL = 0xFF | WDTSSEL__ACLK | WDTIS__64; //intentionally writes incorrect password to WDTCTL to trigger a hard reset
+    while(true); //wait
+}
+#else
+//the host equivalent of a reset is to stop with a core dump
+__attribute__ ((noreturn))
+static void arcos_os_pwr_reset(void) {
+    fprintf(stderr, "arcos: reset\n");
+    abort();
+}
+#endif
+
+#if ARCOS_CONFIG_STACK_CHECK
+//fills a stack with ARCOS_STACK_PAINT and puts ARCOS_STACK_GUARD in its lowest word
+static void arcos_os_stack_paint(arcos_addr_t base, arcos_addr_t size) {
+    uint16_t * word = (uint16_t *) base;
+    uint16_t * top = (uint16_t *) (base + size);
+    *word++ = ARCOS_STACK_GUARD;
+    while (word < top) {
+        *word++ = ARCOS_STACK_PAINT;
+    }
+}
+
+//returns the number of bytes of a painted stack that have ever been written
+static uint16_t arcos_os_stack_usage(arcos_addr_t base, arcos_addr_t size) {
+    uint16_t * word = ((uint16_t *) base) + 1; //skip the guard word
+    uint16_t * top = (uint16_t *) (base + size);
+    while ((word < top) && (*word == ARCOS_STACK_PAINT)) {
+        word++;
+    }
+    return (uint16_t) ((arcos_addr_t) top - (arcos_addr_t) word);
+}
+
+//checks the guard words of the kernel stack and of the process that was just switched out
+//an overflow has already corrupted whatever lies below the stack, so this is treated like any other fatal mistake
+//must be called with interrupts disabled
+static inline void arcos_os_stack_check(void) {
+    if (*((uint16_t *) arcos_var_kernel.stack) != ARCOS_STACK_GUARD) {
+        arcos_os_pwr_reset();
+    }
+    struct arcos_proc_s * handle = arcos_var_kernel.proc_current;
+    if ((handle != NULL) && (handle->stack_size != 0)) {
+        if (*((uint16_t *) handle->stack_base) != ARCOS_STACK_GUARD) {
+            arcos_os_pwr_reset();
+        }
+#ifndef ARCOS_PORT_POSIX
+        if (handle->SP < handle->stack_base) { //the host port does not track SP
+            arcos_os_pwr_reset();
+        }
+#endif
+    }
+}
+#endif
+
+#if ARCOS_CONFIG_STATS
+//starts accounting the run time of a process that is about to be dispatched
+//must be called with interrupts disabled
+static inline void arcos_os_stats_dispatch(struct arcos_proc_s * handle) {
+    uint32_t now = arcos_os_time();
+    arcos_var_kernel.run_stamp = now;
+    handle->stats.last_dispatch = now;
+    handle->stats.dispatches++;
+}
+
+//charges the time since the last dispatch or idle entry to the process that was running, or to idle
+//measured on the 32-bit kernel time, idle can last more than a Timer1_A period when every process sleeps for long
+//must be called with interrupts disabled
+static inline void arcos_os_stats_switch_out(void) {
+    uint32_t elapsed = arcos_os_time() - arcos_var_kernel.run_stamp;
+    if (arcos_var_kernel.proc_current != NULL) {
+        arcos_var_kernel.proc_current->stats.run_ticks += elapsed;
+    } else {
+        arcos_var_kernel.idle_ticks += elapsed;
+    }
+}
+#endif
+
+#if ARCOS_CONFIG_AGING_MS > 0
+//starts the aging clock of a process that has become ready without running
+//must be called with interrupts disabled
+static inline void arcos_os_age_reset(struct arcos_proc_s * handle) {
+    handle->age_stamp = arcos_os_time();
+}
+
+//raises every ready process one level for each ARCOS_AGING_STEP it has waited, up to level 0
+//a waiting process therefore reaches level 0 within ARCOS_CONFIG_AGING_MS, where it shares the CPU round-robin with the
+//  processes that were starving it, so no ready process waits longer than that plus one timeslice per process on level 0
+//runs on every kernel entry, at most ARCOS_CONFIG_PROC_COUNT_MAX processes are checked
+//must be called with interrupts disabled
+ARCOS_SRAM_CODE
+static void arcos_os_age(void) {
+    uint32_t now = arcos_os_time();
+    for (uint8_t i=0; i<arcos_var_kernel.proc_count; i++) {
+        struct arcos_proc_s * handle = arcos_var_kernel.proc_list[i];
+        if ((handle->status != PROC_STATE_READY) || ((now - handle->age_stamp) < ARCOS_AGING_STEP) || (handle->priority < (1 << ARCOS_CONFIG_PRIO_SHIFT))) {
+            continue;
+        }
+        if (!handle->aged) {
+            handle->aged = true;
+            handle->age_priority = handle->priority;
+        }
+        arcos_os_ready_remove(handle);
+        do {
+            handle->priority -= (1 << ARCOS_CONFIG_PRIO_SHIFT);
+            handle->age_stamp += ARCOS_AGING_STEP;
+        } while (((now - handle->age_stamp) >= ARCOS_AGING_STEP) && (handle->priority >= (1 << ARCOS_CONFIG_PRIO_SHIFT)));
+        arcos_os_ready_insert(handle);
+    }
+}
+
+//drops the aging boost of a process that has had its turn on the CPU
+//the boost is kept for the whole timeslice so a woken process cannot immediately push it back down
+//must be called with interrupts disabled
+static inline void arcos_os_age_restore(struct arcos_proc_s * handle) {
+    if (handle->aged) {
+        arcos_os_proc_set_priority(handle, handle->age_priority);
+    }
+    arcos_os_age_reset(handle);
+}
+#endif
+
+#if ARCOS_CONFIG_WARM_BOOT
+//CRC-16-CCITT of a checkpoint using the CRC module, the image is made of 16-bit words
+//only the kernel uses the CRC module, so this can run with interrupts enabled
+static uint16_t arcos_os_boot_crc(const struct arcos_boot_s * image) {
+    const uint16_t * word = (const uint16_t *) &image->time;
+    const uint16_t * end = (const uint16_t *) (image + 1);
+    CRCINIRES = 0xFFFF;
+    while (word < end) {
+        CRCDI = *word++;
+    }
+    return CRCINIRES;
+}
+
+//writes a checkpoint to the image not holding the last one, called from the idle loop
+//the copy, ~3KB with 256 ready levels and ~2KB with ARCOS_CONFIG_PRIO_SHIFT 3, and the CRC run with interrupts enabled, so ISRs are only held off for the few short critical sections here
+//  an ISR that readies a process leaves idle through the slice ISR and abandons the copy, other kernel ISRs count in
+//  boot_changes and the copy is dropped and retried, the application adds nothing to its interrupt latency
+//the time it takes only delays going to sleep, it is estimated, not measured, from the instruction timing at roughly 8 MCLK
+//  cycles per 16-bit word for the copy and 8 for the CRC, ~25K cycles for a 3KB image, ~1.5ms at 16MHz and ~25ms at 1MHz
+//the magic is cleared first and written last, so a reset part way through leaves an image that arcos_resume() rejects
+//processes with a caller owned stack cannot be restored since the stack may be in SRAM, no checkpoint is taken while one exists
+//returns true if an ISR changed the state during the copy and it should be taken again
+//must be called with interrupts disabled and proc_current NULL, returns with interrupts disabled
+static bool arcos_os_boot_save(void) {
+    for (uint8_t i=0; i<arcos_var_kernel.proc_count; i++) {
+        if (arcos_var_kernel.proc_list[i]->stack_size == 0) {
+            return false;
+        }
+    }
+    uint8_t slot = arcos_var_kernel.boot_slot ^ 1;
+    struct arcos_boot_s * image = &arcos_var_boot[slot];
+    uint16_t changes = arcos_var_kernel.boot_changes;
+    image->magic = 0;
+
+    _enable_interrupts();
+    for (uint8_t i=0; i<arcos_var_kernel.proc_count; i++) {
+        image->procs[i] = *arcos_var_kernel.proc_list[i];
+    }
+    memcpy(&image->kernel, &arcos_var_kernel, offsetof(struct arcos_kernel_s, stack));
+#if ARCOS_CONFIG_STACK_POOL_SRAM_SIZE > 0
+    memcpy(image->stack_pool_sram, arcos_var_stack_pool_sram, sizeof(arcos_var_stack_pool_sram));
+#endif
+    _disable_interrupts();
+    if (changes != arcos_var_kernel.boot_changes) {
+        return true;
+    }
+    image->time = arcos_os_time(); //nothing changed during the copy, so it is the state at this time
+
+    _enable_interrupts();
+    uint16_t crc = arcos_os_boot_crc(image);
+    _disable_interrupts();
+    if (changes != arcos_var_kernel.boot_changes) {
+        return true;
+    }
+    image->crc = crc;
+    image->magic = ARCOS_BOOT_MAGIC;
+    arcos_var_boot[arcos_var_kernel.boot_slot].magic = 0;
+    arcos_var_kernel.boot_slot = slot;
+    arcos_var_kernel.boot_saved = true;
+    return false;
+}
+#endif
+
+//bookkeeping for the process that just lost the CPU, every kernel entry passes through here
+//must be called with interrupts disabled
+static inline void arcos_os_switch_out(void) {
+#if ARCOS_CONFIG_STACK_CHECK
+    arcos_os_stack_check();
+#endif
+    if (arcos_var_kernel.proc_current != NULL) {
+        arcos_os_trace(ARCOS_TRACE_KERNEL, arcos_var_kernel.proc_current->id);
+    }
+#if ARCOS_CONFIG_STATS
+    arcos_os_stats_switch_out();
+#endif
+    if ((arcos_var_kernel.proc_current != NULL) && (arcos_var_kernel.proc_current->status == PROC_STATE_TERMINATED)) {
+        arcos_os_proc_stack_release(arcos_var_kernel.proc_current); //process terminated itself, its stack is no longer in use
+    }
+#if ARCOS_CONFIG_AGING_MS > 0
+    if (arcos_var_kernel.proc_current != NULL) {
+        arcos_os_age_restore(arcos_var_kernel.proc_current);
+    }
+    arcos_os_age();
+#endif
+}
+
+//returns the process named by arcos_proc_yield_to(), or NULL if there is none or it can no longer take the slice
+//the handoff is honoured only if nothing ready outranks the donor, so it never delays a process the donor could not have delayed
+//must be called with interrupts disabled, before proc_current is replaced
+static inline struct arcos_proc_s * arcos_os_handoff_take(void) {
+    struct arcos_proc_s * handle = arcos_var_kernel.proc_handoff;
+    if (handle == NULL) {
+        return NULL;
+    }
+    arcos_var_kernel.proc_handoff = NULL;
+    struct arcos_proc_s * donor = arcos_var_kernel.proc_current;
+    if ((handle->status != PROC_STATE_READY) || (donor == NULL) || (arcos_os_ready_level() < (donor->priority >> ARCOS_CONFIG_PRIO_SHIFT))) {
+        return NULL; //target blocked or terminated since, or a higher priority process became ready
+    }
+    arcos_os_ready_remove(handle); //move it to the back of its level, as if the ready scan had picked it
+    arcos_os_ready_insert(handle);
+    return handle;
+}
+
+//simple priority round-robin scheduling
+//constant time regardless of process count, the ready bitmaps locate the highest priority ready level directly
+//picks the next process and marks it running, returns NULL if none is ready
+//WARNING: high priority tasks can starve lower priority tasks, unless ARCOS_CONFIG_AGING_MS bounds how long they wait
+//must be called with interrupts disabled
+static inline struct arcos_proc_s * arcos_os_dispatch(void) {
+    if (arcos_var_kernel.proc_count == 0) { //are there any processes left?
+        arcos_os_pwr_reset(); //There are no more processes left to schedule. This is assumed to be a mistake, so restart the MCU
+    }
+#if ARCOS_CONFIG_WARM_BOOT
+    arcos_os_boot_invalidate(); //the dispatched process is about to change its stack
+#endif
+    struct arcos_proc_s * handle = arcos_os_handoff_take();
+    if (handle != NULL) {
+        arcos_var_kernel.slice = arcos_var_kernel.slice_handoff;
+    } else {
+        handle = arcos_os_ready_next(); //get the first process of the highest priority ready level
+        if (handle != NULL) {
+            arcos_var_kernel.slice = handle->quantum;
+        }
+    }
+    arcos_var_kernel.proc_current = handle;
+    if (handle != NULL) {
+        handle->status = PROC_STATE_RUNNING; //mark the selected process as running
+#if ARCOS_CONFIG_STATS
+        arcos_os_stats_dispatch(handle);
+#endif
+        arcos_os_trace(ARCOS_TRACE_DISPATCH, handle->id);
+    }
+    return handle;
+}
+
+//bookkeeping when no process is ready and the kernel is about to sleep
+//must be called with interrupts disabled
+static inline void arcos_os_idle_enter(void) {
+    arcos_os_trace(ARCOS_TRACE_IDLE, 0);
+#if ARCOS_CONFIG_STATS
+    arcos_var_kernel.run_stamp = arcos_os_time(); //the kernel time base keeps counting while asleep, so the time is accounted as idle
+#endif
+    arcos_var_kernel.proc_current = NULL; //tells the slice ISR there is no process context to save
+}
+
+//bookkeeping when the running process is interrupted by the slice ISR
+//must be called with interrupts disabled
+static inline void arcos_os_preempted(void) {
+    if (arcos_var_kernel.proc_current->status == PROC_STATE_RUNNING) { //process may have terminated, blocked or yielded itself
+        arcos_var_kernel.proc_current->status = PROC_STATE_READY; //mark process as ready to run
+#if ARCOS_CONFIG_STATS
+        arcos_var_kernel.proc_current->stats.preemptions++;
+#endif
+    }
+}
+
+//the head of the sleep queue has reached its tick
+//must be called with interrupts disabled
+ARCOS_SRAM_CODE
+static void arcos_os_sleep_isr(void) {
+    arcos_os_trace(ARCOS_TRACE_ISR_ENTER, ARCOS_TRACE_ISR_SLEEP);
+#if ARCOS_CONFIG_WARM_BOOT
+    arcos_var_kernel.boot_changes++; //the sleep queue deltas move, a checkpoint in progress may have copied half of them
+#endif
+    arcos_os_sleep_advance(arcos_os_time());
+    arcos_os_sleep_program();
+    arcos_os_preempt_check();
+    arcos_os_trace(ARCOS_TRACE_ISR_EXIT, ARCOS_TRACE_ISR_SLEEP);
+}
+
+#ifndef ARCOS_PORT_POSIX
+//runs when no process is ready
+//the timeslice timer is stopped by arcos_os_run(), so no tick wakes the CPU and it sleeps in LPM3 with only ACLK running,
+//  or in LPM0 with SMCLK running while a driver holds it with arcos_lpm0_hold()
+//the next timed event is already armed on Timer1_A CCR0 by arcos_os_sleep_program(), which keeps counting on ACLK
+//any ISR that readies a process requests a context switch, which re-enters the kernel through
+//  arcos_os_isr_timeout_slice() and discards this frame, ISRs that ready nothing return straight to LPM3
+__attribute__ ((noreturn))
+__attribute__ ((naked))
+ARCOS_SRAM_CODE
+static void arcos_os_idle(void) {
+    arcos_os_idle_enter();
+#if ARCOS_CONFIG_WARM_BOOT
+    //nothing changed since the last checkpoint if an ISR woke the kernel without readying anything
+    while (!arcos_var_kernel.boot_saved && arcos_os_boot_save());
+#endif
+    while (true) {
+        if (arcos_var_kernel.lpm0_holds != 0) {
+            __bis_SR_register(LPM0_bits | GIE); //enable interrupts and sleep in one instruction, so a wakeup cannot be missed
+        } else {
+            __bis_SR_register(LPM3_bits | GIE);
+        }
+    }
+}
+
+//dispatches the next process, or idles if none is ready
+__attribute__ ((noreturn))
+__attribute__ ((naked))
+ARCOS_SRAM_CODE
+static void arcos_os_schedule(void) {
+    if (arcos_os_dispatch() == NULL) {
+        arcos_os_idle(); //processes exist but all are stopped or blocked, sleep until an interrupt readies one
+    }
+
+    TA0CCTL0 = CCIE; //clear CCIFG, any pending switch request is satisfied by this pass
+    TA0CCR0 = arcos_var_kernel.slice; //length of this process's timeslice
+    TA0CTL = TASSEL__SMCLK | MC__UP | TACLR; //start the timeslice
+#if ARCOS_CONFIG_WATCHDOG_ENABLE
+    WDT_restart(); //kick the watchdog, it resets the MCU if the scheduler stops dispatching
+#endif
+    //_enable_interrupts(); //not needed because RETI will restore SR and enable interrupts
+#if ARCOS_CONFIG_CONTEXT_16BIT == 1
+    arcos_var_kernel.context_16bit = arcos_var_kernel.proc_current->context_16bit;
+#endif
+    __set_SP_register(arcos_var_kernel.proc_current->SP); //change the stack pointer to the process
+#if ARCOS_CONFIG_CONTEXT_16BIT == 0
+    __asm(" POPM.A #12,R15\n"); //restore context
+#elif ARCOS_CONFIG_CONTEXT_16BIT == 2
+    __asm(" POPM.W #12,R15\n"); //restore context, writing a register with .W clears bits 19:16
+#else
+    //restore context with the width it was saved with, done in one asm block so the compiler cannot touch the process stack
+    __asm(" BIT.B #1, %0\n"
+          " JNZ 1f\n"
+          " POPM.A #12,R15\n"
+          " RETI\n"
+          "1:\n"
+          " POPM.W #12,R15\n"
+          ::"m"(arcos_var_kernel.context_16bit));
+#endif
+    __asm(" RETI\n"); //return control flow to process
+}
+
+//kernel entry point after startup, process pre-emption, etc
+__attribute__ ((noreturn))
+__attribute__ ((naked))
+ARCOS_SRAM_CODE
+static void arcos_os_run(void) {
+    TA0CTL = TASSEL__SMCLK | MC__STOP; //stop the timeslice timer
+#if ARCOS_CONFIG_WATCHDOG_ENABLE
+    WDT_stop(); //hold the watchdog while the kernel runs and idles
+#endif
+    arcos_os_switch_out();
+    //other features added here
+    arcos_os_schedule(); //schedule the next process
+}
+
+//ISR called after timeslice expires, or when a context switch is requested
+//saves context of current process and returns control flow to kernel
+//
+//fixed cost of one full switch in MCLK cycles, estimated from the MSP430X instruction timing in SLAU367
+//the table is not measured, FRAM wait states are excluded, run tools/arcos_cycles.c on the board for real numbers
+//                      interrupt  save  enter kernel  restore  RETI  total
+//  before, PUSHX.A+RETA    6       26        10          26      5     73
+//  20-bit, BRA             6       26         3          26      5     66
+//  16-bit, BRA             6       14         3          14      5     42
+//  per-process mode        adds an estimated 8 for the BIT.B/JNZ/JMP that pick the width on both sides
+//the C in this ISR, arcos_os_run() and arcos_os_schedule() comes on top and depends on the compiler and enabled features
+//FRAM wait states come on top as well, for the process stack and whatever ARCOS_CONFIG_PLACE_SRAM leaves in FRAM
+//yield_switch in tools/arcos_cycles.c measures the whole switch, including all of the above, in MCLK cycles
+__attribute__ ((interrupt(TIMER0_A0_VECTOR)))
+__attribute__ ((naked))
+ARCOS_SRAM_CODE
+static void arcos_os_isr_timeout_slice(void) {
+    //PC and SR are already pushed by the interrupt
+#if ARCOS_CONFIG_CONTEXT_16BIT == 0
+    //Pushes R4-R15 to the stack, saving all 20 bits. Each register uses 4 bytes, so total size is 48bytes
+    __asm(" PUSHM.A #12,R15\n");
+#elif ARCOS_CONFIG_CONTEXT_16BIT == 2
+    //Pushes R4-R15 to the stack, saving only the low 16 bits. Each register uses 2 bytes, so total size is 24bytes
+    __asm(" PUSHM.W #12,R15\n");
+#else
+    //BIT.B only changes SR, which the interrupt already saved, so the width can be picked before any register is touched
+    __asm(" BIT.B #1, %0\n"
+          " JNZ 1f\n"
+          " PUSHM.A #12,R15\n"
+          " JMP 2f\n"
+          "1:\n"
+          " PUSHM.W #12,R15\n"
+          "2:\n"
+          ::"m"(arcos_var_kernel.context_16bit));
+#endif
+    //At this point, process context is saved except SP
+    if (arcos_var_kernel.proc_current != NULL) { //NULL when the kernel was idle, its frame is simply discarded
+        uint16_t proc_SP = __get_SP_register(); //get SP
+        arcos_var_kernel.proc_current->SP = proc_SP; //save process SP
+        arcos_os_preempted();
+    }
+
+    __set_SP_register(arcos_var_kernel.SP); //change stack pointer to kernel
+    __asm(" BRA %0\n"::"i"(&arcos_os_run)); //jump straight to the kernel, arcos_os_run() never returns so nothing needs to be pushed
+}
+
+//Timer1_A CCR0 interrupt, the head of the sleep queue has reached its tick
+__attribute__ ((interrupt(TIMER1_A0_VECTOR)))
+ARCOS_SRAM_CODE
+static void arcos_os_isr_sleep(void) {
+    arcos_os_sleep_isr();
+}
+
+//Timer1_A overflow interrupt, extends the kernel time to 32 bits and re-arms long sleeps
+__attribute__ ((interrupt(TIMER1_A1_VECTOR)))
+ARCOS_SRAM_CODE
+static void arcos_os_isr_time_overflow(void) {
+    if (TA1IV == TA1IV_TAIFG) { //reading TA1IV clears TAIFG
+        arcos_os_trace(ARCOS_TRACE_ISR_ENTER, ARCOS_TRACE_ISR_OVERFLOW); //also guarantees one record per timer wrap, which the decoder relies on
+        arcos_var_kernel.time_hi++;
+#if ARCOS_CONFIG_WARM_BOOT
+        arcos_var_kernel.boot_changes++;
+#endif
+        if (arcos_var_kernel.time_hi == 0) {
+            arcos_var_kernel.time_wraps++;
+        }
+        arcos_os_sleep_advance(arcos_os_time());
+        arcos_os_sleep_program();
+        arcos_os_preempt_check();
+        arcos_os_trace(ARCOS_TRACE_ISR_EXIT, ARCOS_TRACE_ISR_OVERFLOW);
+    }
+}
+#else
+//SIGALRM handler, the host equivalent of the Timer0_A and Timer1_A CCR0 ISRs
+//runs with SIGALRM blocked, so it is an ISR as far as the rest of the kernel is concerned
+//the process context is saved with swapcontext() into the kernel, and resumed by returning from this handler once dispatched again
+static void arcos_os_posix_alarm(int signal) {
+    (void) signal;
+    if (arcos_var_posix.sleep_armed && ((int32_t) (arcos_os_time() - arcos_var_posix.sleep_tick) >= 0)) {
+        arcos_var_posix.sleep_armed = false;
+        arcos_os_sleep_isr();
+    }
+    if (arcos_os_posix_us() >= arcos_var_posix.slice_end) {
+        arcos_var_posix.switch_pending = 1; //timeslice expired
+    }
+    if (!arcos_var_posix.switch_pending || (arcos_var_kernel.proc_current == NULL)) { //while idle the kernel sees switch_pending itself
+        arcos_os_posix_timer_arm();
+        return;
+    }
+    arcos_var_posix.switch_pending = 0;
+    arcos_os_preempted();
+    swapcontext(&arcos_var_kernel.proc_current->context, &arcos_var_posix.kernel);
+}
+#endif
+
+//removes process from process list
+void arcos_proc_terminate(struct arcos_proc_s * handle) {
+    uint16_t GIE_BACKUP = arcos_os_critical_enter();
+
+    if ((handle->status == PROC_STATE_READY) || (handle->status == PROC_STATE_RUNNING)) {
+        arcos_os_ready_remove(handle); //running processes stay on their ready list until they stop being runnable
+    } else if (handle->status == PROC_STATE_BLOCKED) {
+        arcos_os_waitq_remove(handle);
+        if (handle->wait_mutex != NULL) {
+            //the owner, and whatever owner it is waiting on in turn, may have inherited the priority of this process
+            struct arcos_proc_s * owner = handle->wait_mutex->owner;
+            handle->wait_mutex = NULL;
+            while (owner != NULL) {
+                arcos_os_mutex_inherit(owner);
+                owner = (owner->wait_mutex != NULL) ? owner->wait_mutex->owner : NULL;
+            }
+        }
+    } else if (handle->status == PROC_STATE_SLEEPING) {
+        arcos_os_sleep_remove(handle);
+    }
+    while (handle->mutex_held != NULL) { //a terminated process can never unlock, so its mutexes go to their waiters now
+        arcos_os_mutex_release(handle->mutex_held);
+    }
+    handle->status = PROC_STATE_TERMINATED;
+    arcos_os_trace(ARCOS_TRACE_TERMINATE, handle->id);
+    if (handle == arcos_var_kernel.proc_current) {
+        arcos_os_switch_request(); //stop running now, arcos_os_run() releases the stack once it is off of it
+    } else {
+        arcos_os_proc_stack_release(handle);
+        arcos_os_preempt_check(); //a process given one of its mutexes may outrank the current one
+    }
+
+    //finds process index from pointer, order does not matter so the last entry fills the gap
+    for (uint8_t i=0; i<arcos_var_kernel.proc_count; i++) {
+        if (arcos_var_kernel.proc_list[i] == handle) {
+            arcos_var_kernel.proc_list[i] = arcos_var_kernel.proc_list[arcos_var_kernel.proc_count-1];
+            arcos_var_kernel.proc_count--;
+            break;
+        }
+    }
+
+    arcos_os_critical_exit(GIE_BACKUP);
+}
+
+#ifndef ARCOS_PORT_POSIX
+//runs when a process returns
+__attribute__ ((noreturn))
+__attribute__ ((naked))
+static void arcos_os_proc_return(void) {
+    _disable_interrupts();
+
+    arcos_proc_terminate(arcos_var_kernel.proc_current);
+
+    __set_SP_register(arcos_var_kernel.SP);
+    __asm(" BRA %0\n"::"i"(&arcos_os_run));
+}
+
+//initial kernel entry point
+__attribute__ ((noreturn))
+__attribute__ ((naked))
+void arcos_start(void) {
+    _disable_interrupts();
+
+    arcos_var_kernel.SP = (uint16_t) arcos_var_kernel.stack + sizeof(arcos_var_kernel.stack); //valid cast because we know the stacks are in the lower 64K of memory
+#if ARCOS_CONFIG_STATS
+    arcos_var_kernel.run_stamp = arcos_os_time(); //the time before the first dispatch counts as idle
+#endif
+
+    __set_SP_register(arcos_var_kernel.SP);
+    __asm(" BRA %0\n"::"i"(&arcos_os_run));
+}
+#else
+//runs when a process returns
+__attribute__ ((noreturn))
+static void arcos_os_proc_return(void) {
+    sigprocmask(SIG_BLOCK, &arcos_var_posix.alarm, NULL);
+
+    arcos_proc_terminate(arcos_var_kernel.proc_current);
+
+    setcontext(&arcos_var_posix.kernel); //the stack is released by the kernel once it is off of it
+    abort();
+}
+
+//first code run by every process, makecontext() cannot pass the callback so it is taken from the process
+static void arcos_os_posix_entry(void) {
+    arcos_var_kernel.proc_current->callback();
+    arcos_os_proc_return();
+}
+
+//initial kernel entry point, the kernel loop runs on the stack of the caller
+//the host equivalent of arcos_os_run() and arcos_os_schedule(), processes come back here through swapcontext()
+__attribute__ ((noreturn))
+void arcos_start(void) {
+    sigprocmask(SIG_BLOCK, &arcos_var_posix.alarm, NULL);
+#if ARCOS_CONFIG_STATS
+    arcos_var_kernel.run_stamp = arcos_os_time(); //the time before the first dispatch counts as idle
+#endif
+
+    while (true) {
+        arcos_os_switch_out();
+        arcos_var_posix.switch_pending = 0; //any pending switch request is satisfied by this pass
+        struct arcos_proc_s * handle = arcos_os_dispatch();
+        if (handle == NULL) { //sleep until a signal readies a process
+            arcos_os_idle_enter();
+            arcos_var_posix.slice_end = UINT64_MAX;
+            arcos_os_posix_timer_arm();
+            while (!arcos_var_posix.switch_pending) {
+                sigsuspend(&arcos_var_posix.none); //unblock and wait in one call, so a wakeup cannot be missed
+            }
+            continue;
+        }
+        arcos_var_posix.slice_end = arcos_os_posix_us() + arcos_var_kernel.slice + 1; //the timer counts one more than CCR0, like up mode
+        arcos_os_posix_timer_arm();
+        swapcontext(&arcos_var_posix.kernel, &handle->context);
+    }
+}
+#endif
+
+//DCO setting and FRAM wait states of each clock profile
+//FRAM is read at most at 8MHz, NWAITS_n divides MCLK by n+1 for FRAM accesses
+struct arcos_clock_profile_s {
+    uint32_t mclk_hz;
+    uint16_t csctl1;
+    uint8_t nwaits;
+};
+
+#ifndef ARCOS_PORT_POSIX
+    #define ARCOS_CLOCK_PROFILE(hz, csctl1, nwaits) {hz, csctl1, nwaits}
+#else
+    #define ARCOS_CLOCK_PROFILE(hz, csctl1, nwaits) {hz, 0, 0} //no registers to program
+#endif
+
+static const struct arcos_clock_profile_s arcos_var_clock_profiles[] = {
+    [ARCOS_CLOCK_1MHZ] = ARCOS_CLOCK_PROFILE(1000000, DCOFSEL_0, NWAITS_0),
+    [ARCOS_CLOCK_8MHZ] = ARCOS_CLOCK_PROFILE(8000000, DCOFSEL_6, NWAITS_0),
+    [ARCOS_CLOCK_16MHZ] = ARCOS_CLOCK_PROFILE(16000000, DCORSEL | DCOFSEL_4, NWAITS_1),
+    [ARCOS_CLOCK_21MHZ] = ARCOS_CLOCK_PROFILE(21000000, DCORSEL | DCOFSEL_5, NWAITS_2),
+    [ARCOS_CLOCK_24MHZ] = ARCOS_CLOCK_PROFILE(24000000, DCORSEL | DCOFSEL_6, NWAITS_2),
+};
+
+#ifndef ARCOS_PORT_POSIX
+//programs the DCO and FRAM wait states for a profile
+//wait states are raised before MCLK speeds up and lowered after it slows down, so FRAM is never read too fast
+//MCLK is divided by 4 while the DCO settles, as TI recommends when changing DCOFSEL, SMCLK stays on MODCLK throughout
+//must be called with interrupts disabled
+static void arcos_os_clock_apply(uint8_t profile) {
+    const struct arcos_clock_profile_s * next = &arcos_var_clock_profiles[profile];
+
+    //the unlock carries the wait states, writing the password alone would drop them to 0 while MCLK is still fast
+    uint8_t nwaits = FRCTL0_L & (NWAITS0 | NWAITS1 | NWAITS2);
+    if (next->nwaits > nwaits) {
+        nwaits = next->nwaits;
+    }
+    FRCTL0 = FRCTLPW | nwaits; //unlock FRCTL registers, with the larger of the old and new wait states
+
+    CSCTL0 = CSKEY; //unlock CSCTLx registers
+    CSCTL2 = SELA__LFXTCLK | SELS__MODCLK | SELM__DCOCLK; //select clock sources
+    CSCTL3 = DIVA__1 | DIVS__2 | DIVM__4;
+    CSCTL1 = next->csctl1;
+    __delay_cycles(60); //~10us at the slowest divided MCLK
+    CSCTL3 = DIVA__1 | DIVS__2 | DIVM__1; //AUX 32768Hz, SM 2.5Mhz, M from the profile
+    CSCTL0_H = 0; //lock CSCTLx registers
+
+    FRCTL0 = FRCTLPW | next->nwaits;
+    FRCTL0_H = 0; //lock FRCTL registers
+}
+#endif
+
+//tells every registered driver about a profile change
+static void arcos_os_clock_notify(uint8_t phase, uint32_t mclk_hz) {
+    for (struct arcos_clock_notifier_s * notifier = arcos_var_kernel.clock_notifiers; notifier != NULL; notifier = notifier->next) {
+        notifier->callback(phase, mclk_hz);
+    }
+}
+
+#ifndef ARCOS_PORT_POSIX
+//configures the watchdog, clocks, timers and unused ports, shared by a cold boot and a warm boot
+//the kernel time base starts from time_lo, the caller sets time_hi
+static void arcos_os_hw_init(uint16_t time_lo) {
+    WDTCTL = WDTPW | WDTHOLD | WDTSSEL__ACLK | WDTCNTCL | WDTIS__32K; //WDT in watchdog mode, 1s at 32768Hz, held until the scheduler starts it
+
+    TA0CTL = TASSEL__SMCLK | MC__STOP | TACLR; //timeslice timer, started by the scheduler on each dispatch
+    TA0CCTL0 = CCIE; //CCR0 ends the timeslice, setting CCIFG requests a context switch
+
+    TA1CTL = TASSEL__ACLK | ID__1 | MC__STOP | TACLR | TAIE; //kernel time base, free running on ACLK with overflow interrupt
+    TA1R = time_lo;
+    TA1CTL |= MC__CONTINUOUS;
+    TA1CCTL0 = 0; //sleep compare is armed only while a process sleeps
+
+    arcos_os_clock_apply(arcos_var_kernel.clock_profile); //16Mhz after a cold boot, the profile at the checkpoint after a warm boot
+
+    //initialize unused ports to make compiler shut up
+    PADIR = 0x00;
+    PAOUT = 0x00;
+    PBDIR = 0x00;
+    PBOUT = 0x00;
+    PCDIR = 0x00;
+    PCOUT = 0x00;
+    PDDIR = 0x00;
+    PDOUT = 0x00;
+    PEDIR = 0x00;
+    PEOUT = 0x00;
+}
+#endif
+
+//initial configuration of the core, sets up watchdog, clocks, timers, etc.
+//should be called immediately after boot
+void arcos_init(void) {
+#if ARCOS_CONFIG_PLACE_SRAM == 2 && !defined(ARCOS_PORT_POSIX)
+    arcos_os_ramfunc_copy(); //before anything calls the kernel hot paths
+#endif
+#ifndef ARCOS_PORT_POSIX
+    _disable_interrupts();
+#else
+    sigemptyset(&arcos_var_posix.none);
+    sigemptyset(&arcos_var_posix.alarm);
+    sigaddset(&arcos_var_posix.alarm, SIGALRM);
+    sigprocmask(SIG_BLOCK, &arcos_var_posix.alarm, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &arcos_var_posix.epoch); //kernel time starts at 0, like Timer1_A after TACLR
+    arcos_var_posix.slice_end = UINT64_MAX;
+    struct sigaction action = {0};
+    action.sa_handler = &arcos_os_posix_alarm;
+    action.sa_flags = SA_RESTART; //processes doing I/O should not see EINTR because of a context switch
+    sigemptyset(&action.sa_mask); //SIGALRM itself is blocked while its handler runs
+    sigaction(SIGALRM, &action, NULL);
+#endif
+
+#if ARCOS_PLACE_KERNEL_SRAM
+    memset(__arcos_sram_start, 0, __arcos_sram_end - __arcos_sram_start); //NOLOAD, so the C startup does not clear it
+#else
+    memset(&arcos_var_kernel, 0, sizeof(arcos_var_kernel)); //the kernel structure is persistent, so forget any processes left over from before the reset
+#endif
+    arcos_os_stack_pool_init(ARCOS_STACK_POOL_FRAM, (arcos_addr_t) arcos_var_stack_pool_fram, sizeof(arcos_var_stack_pool_fram)); //valid cast because the pool is in the lower 64K of memory
+#if ARCOS_CONFIG_STACK_POOL_SRAM_SIZE > 0
+    arcos_os_stack_pool_init(ARCOS_STACK_POOL_SRAM, (arcos_addr_t) arcos_var_stack_pool_sram, sizeof(arcos_var_stack_pool_sram));
+#endif
+#if ARCOS_CONFIG_STACK_CHECK
+    arcos_os_stack_paint((arcos_addr_t) arcos_var_kernel.stack, sizeof(arcos_var_kernel.stack));
+#endif
+    arcos_var_kernel.clock_profile = ARCOS_CLOCK_16MHZ;
+    arcos_var_kernel.clock_request = ARCOS_CLOCK_16MHZ;
+#if ARCOS_CONFIG_WARM_BOOT
+    arcos_var_boot[0].magic = 0; //the processes of the old checkpoints are gone
+    arcos_var_boot[1].magic = 0;
+#endif
+    arcos_os_trace(ARCOS_TRACE_BOOT, 0); //the trace buffer is not cleared, so the events before a reset are kept
+
+#ifndef ARCOS_PORT_POSIX
+    arcos_os_hw_init(0);
+#endif
+}
+
+#if ARCOS_CONFIG_WARM_BOOT
+//resumes the scheduler from the checkpoint taken the last time the kernel went idle, or runs arcos_init() if there is none
+//call instead of arcos_init() immediately after boot, returns true on a warm boot, the processes are then already created
+//  and continue from where they were when arcos_start() is called, with the kernel time where it was at the checkpoint
+//on false the caller creates its processes as after arcos_init()
+//the checkpoint is only valid while every process is blocked, a reset with any process ready boots cold
+//kernel objects and everything processes keep between blocking calls must be persistent, SRAM is lost on reset
+bool arcos_resume(void) {
+#if ARCOS_CONFIG_PLACE_SRAM == 2
+    arcos_os_ramfunc_copy();
+#endif
+    _disable_interrupts();
+
+    //at most one image is valid, the other was dropped when it was superseded or never completed
+    const struct arcos_boot_s * image = NULL;
+    for (uint8_t slot=0; slot<2; slot++) {
+        if (arcos_var_boot[slot].magic == ARCOS_BOOT_MAGIC
+            && arcos_var_boot[slot].crc == arcos_os_boot_crc(&arcos_var_boot[slot])
+            && arcos_var_boot[slot].kernel.proc_count <= ARCOS_CONFIG_PROC_COUNT_MAX
+            && arcos_var_boot[slot].kernel.proc_current == NULL
+            && arcos_var_boot[slot].kernel.boot_slot == (slot ^ 1)) { //written while the other image held the checkpoint
+            image = &arcos_var_boot[slot];
+        }
+    }
+    if (image == NULL) {
+        arcos_init();
+        return false;
+    }
+
+    memcpy(&arcos_var_kernel, &image->kernel, offsetof(struct arcos_kernel_s, stack));
+    for (uint8_t i=0; i<arcos_var_kernel.proc_count; i++) {
+        *arcos_var_kernel.proc_list[i] = image->procs[i];
+    }
+#if ARCOS_CONFIG_STACK_POOL_SRAM_SIZE > 0
+    memcpy(arcos_var_stack_pool_sram, image->stack_pool_sram, sizeof(arcos_var_stack_pool_sram));
+#endif
+    arcos_var_kernel.time_hi = (uint16_t) (image->time >> 16);
+    //the transfers the holds were taken for did not survive the reset, drivers take them again if they restart one
+    memset(arcos_var_kernel.clock_holds, 0, sizeof(arcos_var_kernel.clock_holds));
+    arcos_var_kernel.lpm0_holds = 0;
+    arcos_var_kernel.clock_profile = arcos_var_kernel.clock_request; //programmed by arcos_os_hw_init()
+    arcos_var_kernel.boot_slot = image - arcos_var_boot;
+    arcos_var_kernel.boot_saved = true; //nothing has changed since the checkpoint
+#if ARCOS_CONFIG_STACK_CHECK
+    arcos_os_stack_paint((arcos_addr_t) arcos_var_kernel.stack, sizeof(arcos_var_kernel.stack));
+#endif
+    arcos_os_trace(ARCOS_TRACE_BOOT, 1);
+
+    arcos_os_hw_init((uint16_t) image->time);
+    arcos_os_sleep_program(); //rearm the compare for the head of the sleep queue
+    return true;
+}
+#endif
+
+//yields timeslice to another process by immediately setting the timeslice interrupt flag
+inline void arcos_proc_yield(void) {
+    uint16_t GIE_BACKUP = arcos_os_critical_enter();
+
+    struct arcos_proc_s * handle = arcos_var_kernel.proc_current;
+    arcos_os_trace(ARCOS_TRACE_YIELD, handle->id);
+#if ARCOS_CONFIG_STATS
+    handle->stats.yields++;
+#endif
+    handle->status = PROC_STATE_READY; //giving up the slice is voluntary, so the slice ISR does not count it as a preemption
+    arcos_os_switch_request();
+
+    arcos_os_critical_exit(GIE_BACKUP); //context switch happens here
+#ifndef ARCOS_PORT_POSIX
+    __asm(" NOP \n");
+#endif
+}
+
+#ifndef ARCOS_PORT_POSIX
+//returns the counts left in the current timeslice, at least 1
+//must be called with interrupts disabled
+static inline uint16_t arcos_os_slice_left(void) {
+    uint16_t count = TA0R;
+    return (count < TA0CCR0) ? (TA0CCR0 - count) : 1;
+}
+#else
+static inline uint16_t arcos_os_slice_left(void) {
+    uint64_t now = arcos_os_posix_us();
+    uint64_t left = (arcos_var_posix.slice_end > now + 1) ? (arcos_var_posix.slice_end - now - 1) : 1; //slice_end is one count past CCR0
+    return (left < 0xFFFF) ? (uint16_t) left : 0xFFFF;
+}
+#endif
+
+//hands the rest of the current timeslice to a ready process, which runs next without going through the ready scan
+//the donor stays ready and is scheduled normally afterwards
+//the handoff is dropped, and this acts like arcos_proc_yield(), if a process with a higher priority than the caller becomes ready first
+//returns false without yielding if handle is not ready or is the caller
+bool arcos_proc_yield_to(struct arcos_proc_s * handle) {
+    uint16_t GIE_BACKUP = arcos_os_critical_enter();
+
+    struct arcos_proc_s * current = arcos_var_kernel.proc_current;
+    if ((handle == current) || (handle->status != PROC_STATE_READY)) {
+        arcos_os_critical_exit(GIE_BACKUP);
+        return false;
+    }
+    arcos_os_trace(ARCOS_TRACE_HANDOFF, handle->id);
+#if ARCOS_CONFIG_STATS
+    current->stats.yields++;
+#endif
+    arcos_var_kernel.proc_handoff = handle;
+    arcos_var_kernel.slice_handoff = arcos_os_slice_left();
+    current->status = PROC_STATE_READY; //voluntary, same as arcos_proc_yield()
+    arcos_os_switch_request();
+
+    arcos_os_critical_exit(GIE_BACKUP); //context switch happens here
+#ifndef ARCOS_PORT_POSIX
+    __asm(" NOP \n");
+#endif
+    return true;
+}
+
+//marks process as ready to run
+void arcos_proc_start(struct arcos_proc_s * handle) {
+    uint16_t GIE_BACKUP = arcos_os_critical_enter();
+
+    if (handle->status == PROC_STATE_STOPPED) { //only a created process that is not already queued can be started
+        arcos_os_trace(ARCOS_TRACE_START, handle->id);
+#if ARCOS_CONFIG_PERIODIC
+        handle->periodic.release = arcos_os_time(); //first job is released now
+        handle->periodic.abs_deadline = handle->periodic.release + handle->periodic.deadline;
+#endif
+#if ARCOS_CONFIG_AGING_MS > 0
+        arcos_os_age_reset(handle);
+#endif
+        handle->status = PROC_STATE_READY;
+        arcos_os_ready_insert(handle);
+        arcos_os_preempt_check(); //may be called from an ISR while the kernel is idle
+    }
+
+    arcos_os_critical_exit(GIE_BACKUP);
+}
+
+//initializes a arcos_proc_s struct, builds its initial context and adds it to the process list
+//the stack is taken from a pool if SP is 0, otherwise SP is used as the top of a caller owned stack
+//returns false, leaving the process uninitialized, if the stack or process list is full
+static bool arcos_os_proc_init(struct arcos_proc_s * handle, void (*callback)(void), arcos_addr_t SP, uint8_t pool, uint16_t stack_size, uint8_t priority) {
+    uint16_t GIE_BACKUP = arcos_os_critical_enter();
+
+    //reserve a process slot and a stack, the process stays uninitialized so nothing can start it yet
+    handle->status = PROC_STATE_UNINITIALIZED;
+    handle->stack_size = 0;
+    if (arcos_var_kernel.proc_count >= ARCOS_CONFIG_PROC_COUNT_MAX) {
+        arcos_os_critical_exit(GIE_BACKUP);
+        return false;
+    }
+    if (SP) {
+#ifdef ARCOS_PORT_POSIX
+        arcos_os_critical_exit(GIE_BACKUP); //makecontext() needs the size of the stack as well
+        return false;
+#endif
+        handle->SP = SP; //use specific stack pointer, if provided
+    } else {
+        arcos_addr_t base = 0;
+        if (stack_size >= ARCOS_PROC_FRAME_SIZE) {
+            base = arcos_os_stack_alloc(pool, &stack_size); //assign a process stack
+        }
+        if (base == 0) {
+            arcos_os_critical_exit(GIE_BACKUP);
+            return false;
+        }
+        handle->stack_base = base;
+        handle->stack_size = stack_size;
+        handle->stack_pool = pool;
+        handle->SP = base + stack_size;
+    }
+    arcos_var_kernel.proc_list[arcos_var_kernel.proc_count] = handle; //add pointer to process list
+    arcos_var_kernel.proc_count++;
+    arcos_var_kernel.proc_id_next++;
+    handle->id = arcos_var_kernel.proc_id_next; //0 is reserved for the kernel
+    arcos_os_trace(ARCOS_TRACE_CREATE, handle->id);
+
+    arcos_os_critical_exit(GIE_BACKUP);
+
+    //initialize arcos_proc_s struct
+    handle->priority = priority;
+    handle->base_priority = priority;
+    handle->callback = callback;
+    handle->next = NULL;
+    handle->prev = NULL;
+    handle->wait_queue = NULL;
+    handle->wait_mutex = NULL;
+    handle->mutex_held = NULL;
+    handle->quantum = ARCOS_SLICE_COUNTS(ARCOS_CONFIG_TIMESLICE_MICROSECONDS);
+#if ARCOS_CONFIG_STATS
+    memset(&handle->stats, 0, sizeof(handle->stats));
+#endif
+#if ARCOS_CONFIG_PERIODIC
+    memset(&handle->periodic, 0, sizeof(handle->periodic));
+#endif
+#if ARCOS_CONFIG_AGING_MS > 0
+    handle->aged = false;
+#endif
+#if ARCOS_CONFIG_CONTEXT_16BIT == 1
+    handle->context_16bit = 0;
+#endif
+
+#if ARCOS_CONFIG_STACK_CHECK
+    if (handle->stack_size != 0) {
+        arcos_os_stack_paint(handle->stack_base, handle->stack_size); //done with interrupts enabled, the stack is not in use yet
+    }
+#endif
+
+#ifdef ARCOS_PORT_POSIX
+    //the initial context starts in arcos_os_posix_entry() on the pool stack with SIGALRM unblocked
+    getcontext(&handle->context);
+    handle->context.uc_stack.ss_sp = (void *) handle->stack_base;
+    handle->context.uc_stack.ss_size = handle->stack_size;
+    handle->context.uc_link = NULL;
+    handle->context.uc_sigmask = arcos_var_posix.none;
+    makecontext(&handle->context, &arcos_os_posix_entry, 0);
+#else
+    //manually manipulate process stack
+    handle->SP -= 4;
+    *((uintptr_t *)handle->SP) = (uintptr_t) &arcos_os_proc_return; //push return address of arcos_os_proc_return()
+    handle->SP -= 2;
+    *((uint16_t *)handle->SP) = ((uint32_t)callback) & 0x0000FFFF; //push process PC
+    handle->SP -= 2;
+    *((uint16_t *)handle->SP) = ((((uint32_t)callback) & 0x000F0000) >> 4) | (0b00001000 & 0x1FF); //push process SR
+    handle->SP -= ARCOS_CONTEXT_REG_SIZE; //push 12 empty registers
+#endif
+
+    handle->status = PROC_STATE_STOPPED; //process can now be started
+    return true;
+}
+
+//0 is highest priority, 255 is lowest priority
+//initializes a arcos_proc_s struct and internal ARCOS variables
+void arcos_proc_create(struct arcos_proc_s * handle, void (*callback)(void), arcos_addr_t SP, uint8_t priority) {
+    arcos_os_proc_init(handle, callback, SP, ARCOS_STACK_POOL_FRAM, ARCOS_CONFIG_PROC_STACK_SIZE_MAX, priority);
+}
+
+//initializes a arcos_proc_s struct with a stack of stack_size bytes from the given pool
+//returns false if the pool or process list is full
+bool arcos_proc_create_stack(struct arcos_proc_s * handle, void (*callback)(void), uint16_t stack_size, uint8_t pool, uint8_t priority) {
+    if (pool >= ARCOS_STACK_POOL_COUNT) {
+        return false;
+    }
+    return arcos_os_proc_init(handle, callback, 0, pool, stack_size, priority);
+}
+
+//initializes a counting semaphore
+void arcos_sem_init(struct arcos_sem_s * sem, uint16_t count) {
+    sem->count = count;
+    sem->waiters = NULL;
+}
+
+//takes one count from a semaphore, blocking without using any CPU time until one is available
+//must not be called from an ISR
+void arcos_sem_wait(struct arcos_sem_s * sem) {
+    uint16_t GIE_BACKUP = arcos_os_critical_enter();
+
+    if (sem->count > 0) {
+        sem->count--;
+    } else {
+        arcos_os_block(&sem->waiters); //arcos_sem_post() hands its count directly to this process
+    }
+
+    arcos_os_critical_exit(GIE_BACKUP); //context switch happens here if the process blocked
+}
+
+//takes one count from a semaphore if one is available, never blocks
+bool arcos_sem_trywait(struct arcos_sem_s * sem) {
+    uint16_t GIE_BACKUP = arcos_os_critical_enter();
+
+    bool taken = false;
+    if (sem->count > 0) {
+        sem->count--;
+        taken = true;
+    }
+
+    arcos_os_critical_exit(GIE_BACKUP);
+    return taken;
+}
+
+//gives one count to a semaphore, waking the highest priority waiting process
+//safe to call from an ISR, a woken higher priority process runs as soon as the ISR returns
+void arcos_sem_post(struct arcos_sem_s * sem) {
+    uint16_t GIE_BACKUP = arcos_os_critical_enter();
+
+    if (sem->waiters != NULL) {
+        arcos_os_wake(arcos_os_waitq_pop(&sem->waiters));
+        arcos_os_preempt_check();
+    } else {
+        sem->count++;
+    }
+
+    arcos_os_critical_exit(GIE_BACKUP);
+}
+
+//initializes an unlocked mutex
+void arcos_mutex_init(struct arcos_mutex_s * mutex) {
+    mutex->owner = NULL;
+    mutex->waiters = NULL;
+    mutex->next_held = NULL;
+}
+
+//locks a mutex, blocking without using any CPU time until it is available
+//the owner inherits the priority of the highest priority process waiting on it
+//must not be called from an ISR
+void arcos_mutex_lock(struct arcos_mutex_s * mutex) {
+    uint16_t GIE_BACKUP = arcos_os_critical_enter();
+
+    struct arcos_proc_s * handle = arcos_var_kernel.proc_current;
+    if (mutex->owner == NULL) {
+        arcos_os_mutex_acquire(mutex, handle);
+    } else {
+        handle->wait_mutex = mutex;
+        arcos_os_block(&mutex->waiters); //arcos_mutex_unlock() hands ownership directly to this process
+
+        //boost the owner, and whatever owner it is waiting on in turn, to the priority of this process
+        struct arcos_proc_s * owner = mutex->owner;
+        while ((owner != NULL) && (owner->priority > handle->priority)) {
+            arcos_os_proc_set_priority(owner, handle->priority);
+            if (owner->wait_mutex == NULL) {
+                break;
+            }
+            owner = owner->wait_mutex->owner;
+        }
+    }
+
+    arcos_os_critical_exit(GIE_BACKUP); //context switch happens here if the process blocked
+}
+
+//locks a mutex if it is available, never blocks
+//must not be called from an ISR
+bool arcos_mutex_trylock(struct arcos_mutex_s * mutex) {
+    uint16_t GIE_BACKUP = arcos_os_critical_enter();
+
+    bool taken = false;
+    if (mutex->owner == NULL) {
+        arcos_os_mutex_acquire(mutex, arcos_var_kernel.proc_current);
+        taken = true;
+    }
+
+    arcos_os_critical_exit(GIE_BACKUP);
+    return taken;
+}
+
+//unlocks a mutex held by the current process and hands it to the highest priority waiting process
+//any inherited priority drops back to what the mutexes still held require
+//must not be called from an ISR
+void arcos_mutex_unlock(struct arcos_mutex_s * mutex) {
+    uint16_t GIE_BACKUP = arcos_os_critical_enter();
+
+    struct arcos_proc_s * handle = arcos_var_kernel.proc_current;
+    if (mutex->owner == handle) {
+        arcos_os_mutex_release(mutex);
+        arcos_os_mutex_inherit(handle); //drop any priority only this mutex required
+        arcos_os_preempt_check();
+    }
+
+    arcos_os_critical_exit(GIE_BACKUP);
+}
+
+//initializes an event group with no flags set
+void arcos_event_init(struct arcos_event_s * event) {
+    event->flags = 0;
+    event->waiters = NULL;
+}
+
+//sets flags and readies every waiting process whose mask now matches, the flags stay set until a waiter takes them
+//only flags and links are touched, so the time spent is bounded by the number of waiters
+//safe to call from an ISR, a woken higher priority process runs as soon as the ISR returns
+void arcos_event_set(struct arcos_event_s * event, uint16_t bits) {
+    uint16_t GIE_BACKUP = arcos_os_critical_enter();
+
+    event->flags |= bits;
+    bool woken = false;
+    struct arcos_proc_s ** link = &event->waiters;
+    while (*link != NULL) {
+        struct arcos_proc_s * handle = *link;
+        if (handle->event_mask & event->flags) {
+            *link = handle->next;
+            handle->wait_queue = NULL;
+            arcos_os_wake(handle);
+            woken = true;
+        } else {
+            link = &handle->next;
+        }
+    }
+    if (woken) {
+        arcos_os_preempt_check();
+    }
+
+    arcos_os_critical_exit(GIE_BACKUP);
+}
+
+//blocks without using any CPU time until any flag in mask is set, then clears and returns the flags of mask that were set
+//must not be called from an ISR
+uint16_t arcos_event_wait(struct arcos_event_s * event, uint16_t mask) {
+    while (true) {
+        uint16_t GIE_BACKUP = arcos_os_critical_enter();
+
+        uint16_t bits = event->flags & mask;
+        if (bits) {
+            event->flags &= ~bits;
+            arcos_os_critical_exit(GIE_BACKUP);
+            return bits;
+        }
+        arcos_var_kernel.proc_current->event_mask = mask;
+        arcos_os_block(&event->waiters); //another waiter may take the flags first, so they are checked again after waking
+
+        arcos_os_critical_exit(GIE_BACKUP); //context switch happens here
+    }
+}
+
+//initializes an empty queue of capacity items of item_size bytes, buffer must hold capacity * item_size bytes
+//returns false if capacity is not a power of 2
+bool arcos_queue_init(struct arcos_queue_s * queue, void * buffer, uint16_t item_size, uint16_t capacity) {
+    if ((capacity == 0) || ((capacity & (capacity - 1)) != 0)) {
+        return false;
+    }
+    queue->buffer = (uint8_t *) buffer;
+    queue->item_size = item_size;
+    queue->mask = capacity - 1;
+    queue->head = 0;
+    queue->tail = 0;
+    queue->waiter = NULL;
+    return true;
+}
+
+//copies an item into the queue without disabling interrupts, returns false if the queue is full
+//only the producer writes tail, so the item is complete before the single 16-bit write that publishes it
+//interrupts are only disabled to wake a consumer that is blocked in arcos_queue_receive()
+//safe to call from an ISR, but only one process or ISR may send to a queue
+bool arcos_queue_send(struct arcos_queue_s * queue, const void * item) {
+    uint16_t tail = queue->tail;
+    if ((uint16_t)(tail - queue->head) > queue->mask) {
+        return false;
+    }
+    memcpy(queue->buffer + ((tail & queue->mask) * queue->item_size), item, queue->item_size);
+    ARCOS_COMPILER_BARRIER(); //the item must be stored before it is published
+    queue->tail = tail + 1;
+    ARCOS_COMPILER_BARRIER(); //waiter must be read after publishing, or a consumer blocking in between would be missed
+
+    if (queue->waiter != NULL) { //pointer reads are a single instruction, so this check does not need a critical section
+        uint16_t GIE_BACKUP = arcos_os_critical_enter();
+        if (queue->waiter != NULL) { //the consumer may have been terminated in the meantime
+            arcos_os_wake(arcos_os_waitq_pop(&queue->waiter));
+            arcos_os_preempt_check();
+        }
+        arcos_os_critical_exit(GIE_BACKUP);
+    }
+    return true;
+}
+
+//copies the oldest item out of the queue without disabling interrupts, returns false if the queue is empty
+//only the consumer writes head, so the slot is not reused by the producer until the item has been copied
+//only one process may receive from a queue
+bool arcos_queue_tryreceive(struct arcos_queue_s * queue, void * item) {
+    uint16_t head = queue->head;
+    if (head == queue->tail) {
+        return false;
+    }
+    ARCOS_COMPILER_BARRIER(); //the item must not be read before tail shows it was published
+    memcpy(item, queue->buffer + ((head & queue->mask) * queue->item_size), queue->item_size);
+    ARCOS_COMPILER_BARRIER(); //the item must be copied before its slot is given back
+    queue->head = head + 1;
+    return true;
+}
+
+//copies the oldest item out of the queue, blocking without using any CPU time while it is empty
+//interrupts are only disabled while deciding to block
+//must not be called from an ISR
+void arcos_queue_receive(struct arcos_queue_s * queue, void * item) {
+    while (!arcos_queue_tryreceive(queue, item)) {
+        uint16_t GIE_BACKUP = arcos_os_critical_enter();
+        if (queue->head == queue->tail) { //checked again, the producer cannot publish and miss the waiter while interrupts are disabled
+            arcos_os_block(&queue->waiter);
+        }
+        arcos_os_critical_exit(GIE_BACKUP); //context switch happens here if the process blocked
+    }
+}
+
+//initializes a pool, building the free list in address order
+void arcos_pool_init(struct arcos_pool_s * pool, void * buffer, uint16_t block_size, uint16_t count) {
+    block_size = ARCOS_POOL_BLOCK_SIZE(block_size);
+    pool->base = (uint8_t *) buffer;
+    pool->free = (count == 0) ? NULL : buffer;
+    for (uint16_t i=0; i<count; i++) {
+        uint8_t * block = pool->base + ((uint32_t) i * block_size); //pools in upper FRAM can be larger than 64K
+        *((void **) block) = (i == (count - 1)) ? NULL : (block + block_size);
+    }
+    memset(&pool->stats, 0, sizeof(pool->stats));
+    pool->stats.block_size = block_size;
+    pool->stats.count = count;
+}
+
+//pops the head of the free list
+//must be called with interrupts disabled
+static inline void * arcos_os_pool_take(struct arcos_pool_s * pool) {
+    void * block = pool->free;
+    if (block == NULL) {
+        pool->stats.failed++;
+        return NULL;
+    }
+    pool->free = *((void **) block);
+    pool->stats.used++;
+    if (pool->stats.used > pool->stats.used_max) {
+        pool->stats.used_max = pool->stats.used;
+    }
+    pool->stats.allocs++;
+    return block;
+}
+
+//pushes a block onto the free list
+//must be called with interrupts disabled
+static inline void arcos_os_pool_give(struct arcos_pool_s * pool, void * block) {
+    *((void **) block) = pool->free;
+    pool->free = block;
+    pool->stats.used--;
+}
+
+void * arcos_pool_alloc(struct arcos_pool_s * pool) {
+    uint16_t GIE_BACKUP = arcos_os_critical_enter();
+    void * block = arcos_os_pool_take(pool);
+    arcos_os_critical_exit(GIE_BACKUP);
+    return block;
+}
+
+void arcos_pool_free(struct arcos_pool_s * pool, void * block) {
+    uint16_t GIE_BACKUP = arcos_os_critical_enter();
+    arcos_os_pool_give(pool, block);
+    arcos_os_critical_exit(GIE_BACKUP);
+}
+
+//each pool is checked in its own critical section, so interrupts are never disabled for more than one pool
+//a miss on the fitting pool is counted as a failure there even if a larger pool serves the request
+void * arcos_pool_alloc_size(struct arcos_pool_s * pools, uint8_t count, uint16_t size) {
+    bool spilled = false;
+    for (uint8_t i=0; i<count; i++) {
+        struct arcos_pool_s * pool = &pools[i];
+        if (pool->stats.block_size < size) {
+            continue;
+        }
+        uint16_t GIE_BACKUP = arcos_os_critical_enter();
+        void * block = arcos_os_pool_take(pool);
+        if (block != NULL) {
+            pool->stats.wasted += pool->stats.block_size - size;
+            if (spilled) {
+                pool->stats.spilled++;
+            }
+        }
+        arcos_os_critical_exit(GIE_BACKUP);
+        if (block != NULL) {
+            return block;
+        }
+        spilled = true;
+    }
+    return NULL;
+}
+
+bool arcos_pool_free_any(struct arcos_pool_s * pools, uint8_t count, void * block) {
+    uintptr_t address = (uintptr_t) block;
+    for (uint8_t i=0; i<count; i++) {
+        uintptr_t base = (uintptr_t) pools[i].base;
+        if ((address >= base) && (address < (base + ((uint32_t) pools[i].stats.count * pools[i].stats.block_size)))) {
+            arcos_pool_free(&pools[i], block);
+            return true;
+        }
+    }
+    return false;
+}
+
+void arcos_pool_stats(struct arcos_pool_s * pool, struct arcos_pool_stats_s * stats) {
+    uint16_t GIE_BACKUP = arcos_os_critical_enter();
+    *stats = pool->stats;
+    arcos_os_critical_exit(GIE_BACKUP);
+}
+
+//returns the current kernel time in ticks of ARCOS_CONFIG_TICK_HZ
+//safe to call from an ISR
+uint32_t arcos_tick_now(void) {
+    uint16_t GIE_BACKUP = arcos_os_critical_enter();
+    uint32_t now = arcos_os_time();
+    arcos_os_critical_exit(GIE_BACKUP);
+    return now;
+}
+
+#if ARCOS_CONFIG_TICK_HZ != 32768
+    #error arcos_time_now() converts 32768Hz ticks
+#endif
+
+//returns the kernel time in microseconds, modulo 2^32
+//one tick is 15625/512us, so with ticks = 512a + b the time is 15625a + 30b + 265b/512, computed without 64-bit math
+//2^32 ticks are 265*2^23 modulo 2^32 microseconds, added once per wrap of the tick count so the result never jumps
+//safe to call from an ISR
+uint32_t arcos_time_now(void) {
+    uint16_t GIE_BACKUP = arcos_os_critical_enter();
+    uint32_t ticks = arcos_os_time();
+    uint16_t wraps = arcos_var_kernel.time_wraps;
+#ifndef ARCOS_PORT_POSIX
+    if ((uint16_t) (ticks >> 16) < arcos_var_kernel.time_hi) { //arcos_os_time() saw an overflow the ISR has not counted yet
+        wraps++;
+    }
+#else
+    wraps = (uint16_t) ((arcos_os_posix_us() * ARCOS_CONFIG_TICK_HZ / 1000000) >> 32);
+#endif
+    arcos_os_critical_exit(GIE_BACKUP);
+
+    return (ticks * 30) + ((ticks >> 9) * 265) + (((ticks & 511) * 265) >> 9) + ((uint32_t) wraps * (265UL << 23));
+}
+
+//puts the current process to sleep until the kernel time reaches tick, returns immediately if it already has
+void arcos_proc_sleep_until(uint32_t tick) {
+    uint16_t GIE_BACKUP = arcos_os_critical_enter();
+    arcos_os_sleep(tick);
+    arcos_os_critical_exit(GIE_BACKUP); //context switch happens here if the process went to sleep
+}
+
+//puts the current process to sleep for a number of ticks
+void arcos_proc_sleep_ticks(uint32_t ticks) {
+    uint16_t GIE_BACKUP = arcos_os_critical_enter();
+    arcos_os_sleep(arcos_os_time() + ticks);
+    arcos_os_critical_exit(GIE_BACKUP); //context switch happens here if the process went to sleep
+}
+
+//puts the current process to sleep for a number of milliseconds
+void arcos_proc_sleep_ms(uint32_t ms) {
+    arcos_proc_sleep_ticks(ARCOS_MS_TO_TICKS(ms));
+}
+
+#if ARCOS_CONFIG_PERIODIC
+//sets the period and relative deadline of a stopped process
+bool arcos_proc_set_periodic(struct arcos_proc_s * handle, uint32_t period, uint32_t deadline) {
+    if (period == 0) {
+        return false;
+    }
+    uint16_t GIE_BACKUP = arcos_os_critical_enter();
+
+    bool stopped = (handle->status == PROC_STATE_STOPPED); //not on any list, so its ordering key can change
+    if (stopped) {
+        handle->periodic.period = period;
+        handle->periodic.deadline = (deadline != 0) ? deadline : period;
+    }
+
+    arcos_os_critical_exit(GIE_BACKUP);
+    return stopped;
+}
+
+//ends the current job and sleeps until the next release
+void arcos_proc_wait_period(void) {
+    uint16_t GIE_BACKUP = arcos_os_critical_enter();
+
+    struct arcos_proc_s * handle = arcos_var_kernel.proc_current;
+    struct arcos_periodic_s * periodic = &handle->periodic;
+    if (periodic->period == 0) {
+        arcos_os_critical_exit(GIE_BACKUP);
+        return;
+    }
+
+    uint32_t now = arcos_os_time();
+    uint32_t response = now - periodic->release;
+    periodic->jobs++;
+    periodic->response_last = response;
+    if (response > periodic->response_max) {
+        periodic->response_max = response;
+    }
+    if (response > periodic->deadline) {
+        periodic->misses++;
+        arcos_os_trace(ARCOS_TRACE_MISS, handle->id);
+    }
+
+    periodic->release += periodic->period;
+    while ((int32_t) (now - periodic->release) >= (int32_t) periodic->period) { //next release is at least a whole period late
+        periodic->release += periodic->period;
+        periodic->misses++;
+        arcos_os_trace(ARCOS_TRACE_MISS, handle->id);
+    }
+    periodic->abs_deadline = periodic->release + periodic->deadline;
+
+    if (!arcos_os_sleep(periodic->release)) { //next job is already released, its new deadline may put it behind another process
+        arcos_os_ready_remove(handle);
+        arcos_os_ready_insert(handle);
+        arcos_os_preempt_check();
+    }
+
+    arcos_os_critical_exit(GIE_BACKUP); //context switch happens here if the process went to sleep
+}
+
+//copies the periodic timing of a process
+void arcos_proc_periodic_stats(struct arcos_proc_s * handle, struct arcos_periodic_s * stats) {
+    uint16_t GIE_BACKUP = arcos_os_critical_enter();
+    *stats = handle->periodic;
+    arcos_os_critical_exit(GIE_BACKUP);
+}
+#endif
+
+//overrides the timeslice length of a process, 0 restores ARCOS_CONFIG_TIMESLICE_MICROSECONDS
+//takes effect the next time the process is dispatched
+void arcos_proc_set_quantum(struct arcos_proc_s * handle, uint32_t microseconds) {
+    if (microseconds == 0) {
+        microseconds = ARCOS_CONFIG_TIMESLICE_MICROSECONDS;
+    }
+    uint32_t counts = ARCOS_SLICE_COUNTS(microseconds);
+    if (counts > 0xFFFF) {
+        counts = 0xFFFF; //longest slice the 16-bit timer can count
+    }
+    handle->quantum = (uint16_t) counts;
+}
+
+//switches MCLK to a profile and tells the registered drivers
+//the host port has no clocks to program, it only tracks the profile and calls the notifiers
+//switches to the requested profile, or to the fastest held one if that is faster
+//must be called with interrupts disabled
+static void arcos_os_clock_update(void) {
+    uint8_t profile = arcos_var_kernel.clock_request;
+    for (uint8_t held = ARCOS_CLOCK_PROFILE_COUNT - 1; held > profile; held--) {
+        if (arcos_var_kernel.clock_holds[held] != 0) {
+            profile = held;
+            break;
+        }
+    }
+    if (profile != arcos_var_kernel.clock_profile) {
+        uint32_t mclk_hz = arcos_var_clock_profiles[profile].mclk_hz;
+        arcos_os_clock_notify(ARCOS_CLOCK_PRE, mclk_hz);
+#ifndef ARCOS_PORT_POSIX
+        arcos_os_clock_apply(profile);
+#endif
+        arcos_var_kernel.clock_profile = profile;
+        arcos_os_clock_notify(ARCOS_CLOCK_POST, mclk_hz);
+    }
+}
+
+//returns the slowest profile allowed by ARCOS_CONFIG_CLOCK_MHZ_MAX with MCLK of at least mclk_hz,
+//  or ARCOS_CLOCK_PROFILE_COUNT if there is none
+static uint8_t arcos_os_clock_profile_min(uint32_t mclk_hz) {
+    for (uint8_t profile=0; profile<ARCOS_CLOCK_PROFILE_COUNT; profile++) {
+        if (arcos_var_clock_profiles[profile].mclk_hz > ((uint32_t) ARCOS_CONFIG_CLOCK_MHZ_MAX * 1000000)) {
+            break;
+        }
+        if (arcos_var_clock_profiles[profile].mclk_hz >= mclk_hz) {
+            return profile;
+        }
+    }
+    return ARCOS_CLOCK_PROFILE_COUNT;
+}
+
+bool arcos_clock_set_profile(uint8_t profile) {
+    if ((profile >= ARCOS_CLOCK_PROFILE_COUNT)
+        || (arcos_var_clock_profiles[profile].mclk_hz > ((uint32_t) ARCOS_CONFIG_CLOCK_MHZ_MAX * 1000000))) {
+        return false;
+    }
+    uint16_t GIE_BACKUP = arcos_os_critical_enter();
+
+    arcos_var_kernel.clock_request = profile;
+    arcos_os_clock_update();
+
+    arcos_os_critical_exit(GIE_BACKUP);
+    return true;
+}
+
+uint8_t arcos_clock_profile(void) {
+    return arcos_var_kernel.clock_profile;
+}
+
+//counts the drivers that need a minimum MCLK in the slowest profile that provides it
+bool arcos_clock_hold(uint32_t mclk_hz) {
+    uint8_t profile = arcos_os_clock_profile_min(mclk_hz);
+    if (profile == ARCOS_CLOCK_PROFILE_COUNT) {
+        return false;
+    }
+    uint16_t GIE_BACKUP = arcos_os_critical_enter();
+    arcos_var_kernel.clock_holds[profile]++;
+    arcos_os_clock_update();
+    arcos_os_critical_exit(GIE_BACKUP);
+    return true;
+}
+
+void arcos_clock_release(uint32_t mclk_hz) {
+    uint8_t profile = arcos_os_clock_profile_min(mclk_hz);
+    if (profile == ARCOS_CLOCK_PROFILE_COUNT) {
+        return;
+    }
+    uint16_t GIE_BACKUP = arcos_os_critical_enter();
+    if (arcos_var_kernel.clock_holds[profile] != 0) {
+        arcos_var_kernel.clock_holds[profile]--;
+        arcos_os_clock_update();
+    }
+    arcos_os_critical_exit(GIE_BACKUP);
+}
+
+uint32_t arcos_clock_mclk_hz(void) {
+    return arcos_var_clock_profiles[arcos_var_kernel.clock_profile].mclk_hz;
+}
+
+//counts the drivers that need SMCLK while the kernel is idle
+//a release while the CPU sleeps in LPM0 takes effect at the next wakeup, since the ISR returns to the mode it interrupted
+void arcos_lpm0_hold(void) {
+    uint16_t GIE_BACKUP = arcos_os_critical_enter();
+    arcos_var_kernel.lpm0_holds++;
+    arcos_os_critical_exit(GIE_BACKUP);
+}
+
+void arcos_lpm0_release(void) {
+    uint16_t GIE_BACKUP = arcos_os_critical_enter();
+    if (arcos_var_kernel.lpm0_holds != 0) {
+        arcos_var_kernel.lpm0_holds--;
+    }
+    arcos_os_critical_exit(GIE_BACKUP);
+}
+
+//adds a notifier to the front of the list, unless it is already on it
+void arcos_clock_notify(struct arcos_clock_notifier_s * notifier, void (*callback)(uint8_t phase, uint32_t mclk_hz)) {
+    uint16_t GIE_BACKUP = arcos_os_critical_enter();
+
+    struct arcos_clock_notifier_s * entry = arcos_var_kernel.clock_notifiers;
+    while ((entry != NULL) && (entry != notifier)) {
+        entry = entry->next;
+    }
+    notifier->callback = callback;
+    if (entry == NULL) {
+        notifier->next = arcos_var_kernel.clock_notifiers;
+        arcos_var_kernel.clock_notifiers = notifier;
+    }
+
+    arcos_os_critical_exit(GIE_BACKUP);
+}
+
+#if ARCOS_CONFIG_STACK_CHECK
+//returns the most stack the process has ever used in bytes, 0 if the stack is caller owned
+uint16_t arcos_proc_stack_usage(struct arcos_proc_s * handle) {
+    if (handle->stack_size == 0) {
+        return 0;
+    }
+    return arcos_os_stack_usage(handle->stack_base, handle->stack_size);
+}
+
+//returns the most kernel stack ever used in bytes
+uint16_t arcos_kernel_stack_usage(void) {
+    return arcos_os_stack_usage((arcos_addr_t) arcos_var_kernel.stack, sizeof(arcos_var_kernel.stack));
+}
+#endif
+
+#if ARCOS_CONFIG_CONTEXT_16BIT == 1
+//switches a process to 16-bit context saves, halving its saved context to 24 bytes
+//only valid before the process is first started, returns false otherwise
+bool arcos_proc_set_context_16bit(struct arcos_proc_s * handle) {
+    uint16_t GIE_BACKUP = arcos_os_critical_enter();
+
+    bool done = false;
+    if ((handle->status == PROC_STATE_STOPPED) && (handle->context_16bit == 0)) {
+        handle->SP += 2 * 12; //the initial registers hold nothing, so dropping the upper half of the frame keeps PC, SR and the return address in place
+        handle->context_16bit = 1;
+        done = true;
+    }
+
+    arcos_os_critical_exit(GIE_BACKUP);
+    return done;
+}
+#endif
+
+#if ARCOS_CONFIG_TRACE_SIZE > 0
+//records the entry of an application ISR in the trace buffer
+//must be called from the ISR, id should be below the ids reserved by the kernel
+void arcos_trace_isr_enter(uint8_t id) {
+    arcos_os_trace(ARCOS_TRACE_ISR_ENTER, id);
+}
+
+//records the exit of an application ISR in the trace buffer
+void arcos_trace_isr_exit(uint8_t id) {
+    arcos_os_trace(ARCOS_TRACE_ISR_EXIT, id);
+}
+#endif
+
+#if ARCOS_CONFIG_STATS
+//copies the accounting of every process, and the idle time, in one critical section so all values are consistent
+//the slice in progress is included in the run time of the calling process
+void arcos_stats_snapshot(struct arcos_stats_s * snapshot) {
+    uint16_t GIE_BACKUP = arcos_os_critical_enter();
+
+    uint32_t now = arcos_os_time();
+    uint32_t elapsed = now - arcos_var_kernel.run_stamp;
+    snapshot->now = now;
+    snapshot->idle_ticks = arcos_var_kernel.idle_ticks;
+    snapshot->count = arcos_var_kernel.proc_count;
+    for (uint8_t i=0; i<arcos_var_kernel.proc_count; i++) {
+        struct arcos_proc_s * handle = arcos_var_kernel.proc_list[i];
+        snapshot->procs[i].handle = handle;
+        snapshot->procs[i].id = handle->id;
+        snapshot->procs[i].priority = handle->priority;
+        snapshot->procs[i].status = handle->status;
+        snapshot->procs[i].stats = handle->stats;
+        if (handle == arcos_var_kernel.proc_current) {
+            snapshot->procs[i].stats.run_ticks += elapsed;
+        }
+    }
+
+    arcos_os_critical_exit(GIE_BACKUP);
 }
+#endif
@@ -85,7 +85,7 @@ WDT intervals:
 81,920 bytes 20-bit address FRAM (slowest):
 0x010000-0x023FFFF - general space
     0x010000-0x0..... - code
-    0x0.....-0x023FFF - heap
+    0x0.....-0x023FFF - heap, block pools placed with ARCOS_POOL_FRAM
 
  */
 
@@ -97,43 +97,433 @@ WDT intervals:
 
 #include "arcos_config.h"
 
+#ifdef ARCOS_PORT_POSIX
+    #include <ucontext.h>
+    typedef uintptr_t arcos_addr_t; //address of a stack or stack pointer
+#else
+    typedef uint16_t arcos_addr_t; //address of a stack or stack pointer, stacks are in the lower 64K of memory
+#endif
+
 //possible states of a process
 enum arcos_proc_status_e {
     PROC_STATE_UNINITIALIZED = 0,
     PROC_STATE_TERMINATED,
     PROC_STATE_STOPPED,
     //PROC_STATE_SUSPENDED, //future use
-    //PROC_STATE_BLOCKED, //future use
+    PROC_STATE_BLOCKED, //waiting on a semaphore or mutex, uses no CPU time
+    PROC_STATE_SLEEPING, //waiting for a tick, uses no CPU time
     PROC_STATE_READY,
     PROC_STATE_RUNNING,
 };
 
+struct arcos_mutex_s;
+
+#if ARCOS_CONFIG_STATS
+//CPU accounting of one process, maintained by the kernel, times are in kernel ticks
+struct arcos_proc_stats_s {
+    uint32_t run_ticks; //total time spent running, including ISRs that interrupted it
+    uint32_t last_dispatch; //kernel time of the last dispatch
+    uint32_t dispatches; //number of times the process was given the CPU
+    uint32_t yields; //number of arcos_proc_yield() and arcos_proc_yield_to() calls
+    uint32_t preemptions; //number of times the process lost the CPU while it could still run, by slice expiry or a higher priority process
+};
+#endif
+
+#if ARCOS_CONFIG_PERIODIC
+//release timing and deadline accounting of a periodic process, times are in kernel ticks
+struct arcos_periodic_s {
+    uint32_t period; //0 if the process is not periodic
+    uint32_t deadline; //relative to each release
+    uint32_t release; //kernel time the current job was released
+    uint32_t abs_deadline; //release + deadline, orders the ready level under EDF
+    uint32_t jobs; //completed jobs
+    uint32_t misses; //jobs completed after their deadline, plus releases skipped because a job overran a whole period
+    uint32_t response_max; //worst case time from release to completion
+    uint32_t response_last; //time from release to completion of the last job
+};
+#endif
+
 //describes a particular process
 //included in header so size is known
 struct arcos_proc_s {
-    uint8_t priority;
+    uint8_t priority; //effective priority, may be raised by priority inheritance
+    uint8_t base_priority; //priority given at creation
     enum arcos_proc_status_e status;
-    uint16_t SP;
+    arcos_addr_t SP;
     void (*callback)(void);
+    struct arcos_proc_s * next; //ready list or wait queue links, managed by the kernel
+    struct arcos_proc_s * prev;
+    struct arcos_proc_s ** wait_queue; //wait queue this process is blocked on
+    struct arcos_mutex_s * wait_mutex; //mutex this process is blocked on, used for priority inheritance
+    struct arcos_mutex_s * mutex_held; //list of mutexes owned by this process
+    uint32_t wake_delta; //ticks after the previous entry of the sleep queue that this process wakes
+    uint16_t quantum; //timeslice length as a Timer0_A CCR0 value, set with arcos_proc_set_quantum()
+    arcos_addr_t stack_base; //lowest address of a pool allocated stack
+    uint16_t stack_size; //size of a pool allocated stack, 0 if the stack is owned by the caller
+    uint8_t stack_pool; //pool the stack was allocated from
+#ifdef ARCOS_PORT_POSIX
+    ucontext_t context; //saved context, replaces the register frame on the process stack
+#endif
+    uint16_t event_mask; //flags this process is waiting for while blocked in arcos_event_wait()
+    uint8_t id; //non-zero id assigned at creation, identifies the process in the trace buffer
+#if ARCOS_CONFIG_STATS
+    struct arcos_proc_stats_s stats;
+#endif
+#if ARCOS_CONFIG_PERIODIC
+    struct arcos_periodic_s periodic;
+#endif
+#if ARCOS_CONFIG_AGING_MS > 0
+    uint32_t age_stamp; //kernel time the process started waiting, or last rose a level, while ready
+    uint8_t age_priority; //priority before aging raised it, restored once the process has run
+    bool aged; //priority has been raised by aging
+#endif
+#if ARCOS_CONFIG_CONTEXT_16BIT == 1
+    uint8_t context_16bit; //1 if R4-R15 are saved with PUSHM.W, set with arcos_proc_set_context_16bit()
+#endif
+};
+
+//counting semaphore, must be initialized with arcos_sem_init()
+struct arcos_sem_s {
+    uint16_t count;
+    struct arcos_proc_s * waiters; //blocked processes, highest priority first
+};
+
+//mutex with priority inheritance, must be initialized with arcos_mutex_init()
+struct arcos_mutex_s {
+    struct arcos_proc_s * owner;
+    struct arcos_proc_s * waiters; //blocked processes, highest priority first
+    struct arcos_mutex_s * next_held; //next mutex held by the same owner
+};
+
+//group of 16 event flags that processes can wait on, must be initialized with arcos_event_init()
+//lets an ISR defer its work to a process by setting a flag
+struct arcos_event_s {
+    uint16_t flags;
+    struct arcos_proc_s * waiters; //blocked processes, highest priority first
+};
+
+//fixed-capacity single-producer single-consumer queue, must be initialized with arcos_queue_init()
+//head and tail run freely and are each written by only one side, 16-bit accesses are atomic so neither side disables interrupts
+struct arcos_queue_s {
+    uint8_t * buffer;
+    uint16_t item_size;
+    uint16_t mask; //capacity - 1
+    volatile uint16_t head; //count of items received, written only by the consumer
+    volatile uint16_t tail; //count of items sent, written only by the producer
+    struct arcos_proc_s * waiter; //consumer blocked in arcos_queue_receive(), used as a wait queue
+};
+
+//counters of a block pool, copied out by arcos_pool_stats()
+struct arcos_pool_stats_s {
+    uint16_t block_size; //bytes per block after rounding
+    uint16_t count; //blocks in the pool
+    uint16_t used; //blocks allocated now
+    uint16_t used_max; //most blocks ever allocated at once
+    uint16_t failed; //allocations that found the pool empty
+    uint16_t spilled; //allocations by arcos_pool_alloc_size() served here because every smaller fitting pool was empty
+    uint32_t allocs; //successful allocations
+    uint32_t wasted; //bytes of the block left unused by arcos_pool_alloc_size() requests, summed over all allocations
+};
+
+//fixed-size block allocator, must be initialized with arcos_pool_init()
+//free blocks are kept on a singly linked list threaded through the blocks, so alloc and free are O(1)
+struct arcos_pool_s {
+    void * free; //first free block, each free block starts with a pointer to the next
+    uint8_t * base;
+    struct arcos_pool_stats_s stats;
+};
+
+//driver callback run around every clock profile change, registered with arcos_clock_notify()
+//phase is ARCOS_CLOCK_PRE before the change and ARCOS_CLOCK_POST after it, mclk_hz is the MCLK of the new profile
+struct arcos_clock_notifier_s {
+    void (*callback)(uint8_t phase, uint32_t mclk_hz);
+    struct arcos_clock_notifier_s * next;
 };
 
 //marks process as ready for execution
 void arcos_proc_start(struct arcos_proc_s * handle);
 
 //terminates specified process
+//mutexes it holds are handed to their waiters, and a mutex owner loses any priority it inherited from it
 void arcos_proc_terminate(struct arcos_proc_s * handle);
 
 //yields timeslice to another process
+//a periodic process keeps the head of its ready level until arcos_proc_wait_period(), so its yield just dispatches it again
 void arcos_proc_yield(void);
 
+//hands the rest of the current timeslice directly to a ready process, bypassing the priority scan
+//meant for pipelines, e.g. a producer handing off to its consumer right after waking it
+//returns false without yielding if handle is not ready
+bool arcos_proc_yield_to(struct arcos_proc_s * handle);
+
 //initializes a arcos_proc_s struct and internal ARCOS variables
 //0 is highest priority, 255 is lowest priority
-void arcos_proc_create(struct arcos_proc_s * handle, void (*callback)(void), uint16_t SP, uint8_t priority);
+//every priority is its own level by default, processes at the same priority share the CPU round-robin
+//with ARCOS_CONFIG_PRIO_SHIFT above 0 priorities are merged into bands of 2^ARCOS_CONFIG_PRIO_SHIFT, e.g. with 3 priority 100 and 103 share a band and do not preempt each other
+//SP of 0 allocates a ARCOS_CONFIG_PROC_STACK_SIZE_MAX byte stack from the FRAM pool, otherwise SP is the top of a caller owned stack
+//the host port only supports pool allocated stacks, SP must be 0
+//the process is left PROC_STATE_UNINITIALIZED if no stack or process slot is available
+void arcos_proc_create(struct arcos_proc_s * handle, void (*callback)(void), arcos_addr_t SP, uint8_t priority);
+
+//stack pools for arcos_proc_create_stack()
+#define ARCOS_STACK_POOL_FRAM (0) //ARCOS_CONFIG_STACK_POOL_FRAM_SIZE bytes of FRAM
+#define ARCOS_STACK_POOL_SRAM (1) //ARCOS_CONFIG_STACK_POOL_SRAM_SIZE bytes of SRAM, faster with no wait states
+
+//initializes a arcos_proc_s struct with a stack of stack_size bytes from a stack pool
+//the stack is returned to the pool when the process terminates
+//stack_size must be at least 56 bytes for the initial context, plus whatever the process and nested ISRs use
+//returns false if the pool or process list is full
+bool arcos_proc_create_stack(struct arcos_proc_s * handle, void (*callback)(void), uint16_t stack_size, uint8_t pool, uint8_t priority);
+
+#if ARCOS_CONFIG_STACK_CHECK
+//returns the high-water mark of a process stack in bytes, including nested ISR frames
+//only pool allocated stacks are painted, returns 0 for caller owned stacks
+uint16_t arcos_proc_stack_usage(struct arcos_proc_s * handle);
+
+//returns the high-water mark of the kernel stack in bytes
+uint16_t arcos_kernel_stack_usage(void);
+#endif
+
+#if ARCOS_CONFIG_CONTEXT_16BIT == 1
+//makes the kernel save only the low 16 bits of R4-R15 for this process, halving its context switch memory traffic
+//WARNING: the process must never hold an address above 64K in a register, so its code, data, and any kernel objects it passes
+//  (semaphores, mutexes, ...) must all be in the lower 64K of memory. Must be called before arcos_proc_start().
+bool arcos_proc_set_context_16bit(struct arcos_proc_s * handle);
+#endif
+
+#if ARCOS_CONFIG_TRACE_SIZE > 0
+//record ISR entry and exit in the trace buffer, id is chosen by the application and must be below 0xFE
+void arcos_trace_isr_enter(uint8_t id);
+void arcos_trace_isr_exit(uint8_t id);
+#else
+    #define arcos_trace_isr_enter(id)
+    #define arcos_trace_isr_exit(id)
+#endif
+
+#if ARCOS_CONFIG_STATS
+//consistent copy of the CPU accounting of every process, filled by arcos_stats_snapshot()
+//the share of a process over an interval is the difference of its run_ticks between two snapshots divided by the difference of now
+struct arcos_stats_s {
+    uint32_t now; //kernel time of the snapshot
+    uint32_t idle_ticks; //total time spent with no process ready
+    uint8_t count; //number of valid entries in procs
+    struct {
+        struct arcos_proc_s * handle;
+        uint8_t id;
+        uint8_t priority;
+        uint8_t status;
+        struct arcos_proc_stats_s stats;
+    } procs[ARCOS_CONFIG_PROC_COUNT_MAX];
+};
+
+//copies the CPU accounting of all processes atomically
+void arcos_stats_snapshot(struct arcos_stats_s * snapshot);
+#endif
+
+//overrides the timeslice length of a process, 0 restores ARCOS_CONFIG_TIMESLICE_MICROSECONDS
+//short slices suit latency sensitive processes, long slices suit batch work such as rendering
+//clamped to the longest slice the 16-bit timer can count, ~26ms at 2.5MHz SMCLK
+void arcos_proc_set_quantum(struct arcos_proc_s * handle, uint32_t microseconds);
+
+//converts milliseconds to kernel ticks, overflows above ~17 minutes at 32768Hz
+#define ARCOS_MS_TO_TICKS(ms) ((((uint32_t)(ms)) * (ARCOS_CONFIG_TICK_HZ / 8)) / 125)
+
+#if ARCOS_CONFIG_PERIODIC
+//makes a stopped process periodic, the kernel releases a job every period ticks, starting when arcos_proc_start() is called
+//each job must finish within deadline ticks of its release, 0 makes the deadline equal to the period
+//priority still decides between levels, assign shorter periods higher priorities to get rate monotonic scheduling
+//within a level, periodic processes run ahead of the other processes and are not time-sliced, ordered by
+//  relative deadline (deadline monotonic), or by absolute deadline (EDF) if ARCOS_CONFIG_SCHED_EDF is 1
+//returns false if the process is not stopped or period is 0
+bool arcos_proc_set_periodic(struct arcos_proc_s * handle, uint32_t period, uint32_t deadline);
+
+//ends the current job of a periodic process, records its response time and sleeps until the next release
+//a job that overruns a whole period skips the releases it missed instead of running late jobs back to back
+//returns immediately if the calling process is not periodic
+void arcos_proc_wait_period(void);
+
+//copies the release timing and deadline counters of a periodic process atomically
+void arcos_proc_periodic_stats(struct arcos_proc_s * handle, struct arcos_periodic_s * stats);
+#endif
+
+//returns the current kernel time in ticks of ARCOS_CONFIG_TICK_HZ, wraps after ~36 hours at 32768Hz
+//safe to call from an ISR
+uint32_t arcos_tick_now(void);
+
+//returns the kernel time in microseconds, with the ~30.5us resolution of the tick, wraps after ~71.6 minutes
+//monotonic and counted from the LFXT crystal, running in every low power mode, so it suits profiling, pacing, debouncing and timeouts
+//take differences with unsigned subtraction, e.g. (arcos_time_now() - start) > 20000 for a 20ms timeout
+//safe to call from an ISR
+uint32_t arcos_time_now(void);
+
+//converts between microseconds, milliseconds and kernel ticks, rounding down
+//these use 64-bit math, which is free for constants but slow at runtime on the MSP430
+#define ARCOS_US_TO_TICKS(us) ((uint32_t) ((((uint64_t) (us)) * (ARCOS_CONFIG_TICK_HZ / 64)) / 15625))
+#define ARCOS_TICKS_TO_US(ticks) ((uint32_t) ((((uint64_t) (ticks)) * 15625) / (ARCOS_CONFIG_TICK_HZ / 64)))
+#define ARCOS_TICKS_TO_MS(ticks) ((uint32_t) ((((uint64_t) (ticks)) * 125) / (ARCOS_CONFIG_TICK_HZ / 8)))
+
+//puts the current process to sleep for a number of ticks, it uses no CPU time while asleep
+void arcos_proc_sleep_ticks(uint32_t ticks);
+
+//puts the current process to sleep for a number of milliseconds
+void arcos_proc_sleep_ms(uint32_t ms);
+
+//puts the current process to sleep until the kernel time reaches tick, returns immediately if it already has
+//adding a fixed period to the previous wake tick gives drift-free periodic loops
+void arcos_proc_sleep_until(uint32_t tick);
+
+//initializes a counting semaphore
+void arcos_sem_init(struct arcos_sem_s * sem, uint16_t count);
+
+//takes one count from a semaphore, blocking until one is available
+//must not be called from an ISR
+void arcos_sem_wait(struct arcos_sem_s * sem);
+
+//takes one count from a semaphore if one is available, never blocks
+bool arcos_sem_trywait(struct arcos_sem_s * sem);
+
+//gives one count to a semaphore, waking the highest priority waiting process
+//safe to call from an ISR
+void arcos_sem_post(struct arcos_sem_s * sem);
+
+//initializes an unlocked mutex
+void arcos_mutex_init(struct arcos_mutex_s * mutex);
+
+//locks a mutex, blocking until it is available
+//the owner inherits the priority of the highest priority process waiting on it
+//must not be called from an ISR
+void arcos_mutex_lock(struct arcos_mutex_s * mutex);
+
+//locks a mutex if it is available, never blocks
+//must not be called from an ISR
+bool arcos_mutex_trylock(struct arcos_mutex_s * mutex);
+
+//unlocks a mutex held by the current process
+//must not be called from an ISR
+void arcos_mutex_unlock(struct arcos_mutex_s * mutex);
+
+//initializes an event group with no flags set
+void arcos_event_init(struct arcos_event_s * event);
+
+//sets flags, readying every waiting process whose mask matches
+//safe to call from an ISR
+void arcos_event_set(struct arcos_event_s * event, uint16_t bits);
+
+//blocks until any flag in mask is set, then clears and returns the flags of mask that were set
+//must not be called from an ISR
+uint16_t arcos_event_wait(struct arcos_event_s * event, uint16_t mask);
+
+//initializes an empty queue of capacity items of item_size bytes, buffer must hold capacity * item_size bytes
+//returns false if capacity is not a power of 2
+bool arcos_queue_init(struct arcos_queue_s * queue, void * buffer, uint16_t item_size, uint16_t capacity);
+
+//copies an item into the queue, returns false if it is full, never blocks
+//safe to call from an ISR, a queue must have only one sender
+bool arcos_queue_send(struct arcos_queue_s * queue, const void * item);
+
+//copies the oldest item out of the queue, returns false if it is empty, never blocks
+//a queue must have only one receiver
+bool arcos_queue_tryreceive(struct arcos_queue_s * queue, void * item);
+
+//copies the oldest item out of the queue, blocking until one is sent
+//must not be called from an ISR, a queue must have only one receiver
+void arcos_queue_receive(struct arcos_queue_s * queue, void * item);
+
+//rounds a block size up to what arcos_pool_init() uses, each block must be able to hold the free list pointer
+#define ARCOS_POOL_BLOCK_SIZE(size) (((((size) < sizeof(void *)) ? sizeof(void *) : (size)) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+
+//placement of pool buffers, e.g. ARCOS_POOL_FRAM uint8_t buffer[32 * ARCOS_POOL_BLOCK_SIZE(100)];
+//upper FRAM holds large pools without using the 16-bit address space, SRAM suits small pools of hot objects
+#ifndef ARCOS_PORT_POSIX
+    #define ARCOS_POOL_FRAM __attribute__ ((upper))
+    #define ARCOS_POOL_SRAM __attribute__ ((lower))
+#else
+    #define ARCOS_POOL_FRAM
+    #define ARCOS_POOL_SRAM
+#endif
+
+//initializes a pool of count blocks, buffer must hold count * ARCOS_POOL_BLOCK_SIZE(block_size) bytes
+void arcos_pool_init(struct arcos_pool_s * pool, void * buffer, uint16_t block_size, uint16_t count);
+
+//takes a block from the pool in constant time, returns NULL if the pool is empty, never blocks
+//safe to call from an ISR
+void * arcos_pool_alloc(struct arcos_pool_s * pool);
+
+//returns a block to the pool it was allocated from in constant time
+//safe to call from an ISR
+void arcos_pool_free(struct arcos_pool_s * pool, void * block);
+
+//allocates size bytes from a set of size classes, pools must be ordered by increasing block size
+//takes a block from the smallest pool that fits, or from the next larger pool if that one is empty
+//returns NULL if size is larger than every block or every fitting pool is empty, takes at most count steps
+//safe to call from an ISR
+void * arcos_pool_alloc_size(struct arcos_pool_s * pools, uint8_t count, uint16_t size);
+
+//returns a block from arcos_pool_alloc_size() to the pool that holds it, found by address
+//returns false if the block is not in any of the pools
+//safe to call from an ISR
+bool arcos_pool_free_any(struct arcos_pool_s * pools, uint8_t count, void * block);
+
+//copies the usage counters of a pool atomically
+//free blocks are all the same size so a pool never fragments externally, wasted / allocs is the average internal fragmentation
+void arcos_pool_stats(struct arcos_pool_s * pool, struct arcos_pool_stats_s * stats);
+
+//MCLK profiles for arcos_clock_set_profile(), steps of the DCO
+//SMCLK stays on MODCLK/2 in every profile, so timeslices, the LED SPI bit clock and anything else on SMCLK keep their timing
+#define ARCOS_CLOCK_1MHZ (0)
+#define ARCOS_CLOCK_8MHZ (1)
+#define ARCOS_CLOCK_16MHZ (2) //profile set by arcos_init()
+#define ARCOS_CLOCK_21MHZ (3) //above the 16MHz rating of the MSP430FR6989, needs ARCOS_CONFIG_CLOCK_MHZ_MAX
+#define ARCOS_CLOCK_24MHZ (4)
+
+//notifier phases
+#define ARCOS_CLOCK_PRE (0)
+#define ARCOS_CLOCK_POST (1)
+
+//switches MCLK to a profile, setting the FRAM wait states the new frequency needs
+//while an arcos_clock_hold() needs a faster profile MCLK stays there, and drops to this profile once it is released
+//every notifier is called before and after the switch, with interrupts disabled, so callbacks must be short
+//returns false if the profile does not exist or is faster than ARCOS_CONFIG_CLOCK_MHZ_MAX
+bool arcos_clock_set_profile(uint8_t profile);
+
+//returns the current profile, which can be faster than the one set while a hold is in place
+uint8_t arcos_clock_profile(void);
+
+//returns the current MCLK frequency in Hz
+uint32_t arcos_clock_mclk_hz(void);
+
+//keeps MCLK at least mclk_hz, for a driver that needs the CPU or the DMA to keep up with a peripheral, e.g. DMA fed SPI
+//raises MCLK to the slowest profile that is fast enough if the current one is slower, until every hold is released
+//each hold must be released exactly once with the same mclk_hz, the switch happens in the caller so a release from an
+//  ISR spends the ~10us the DCO takes to settle there
+//returns false if no profile allowed by ARCOS_CONFIG_CLOCK_MHZ_MAX is fast enough
+//holds do not survive arcos_resume(), which restores the profile last set and leaves every hold released
+//safe to call from an ISR
+bool arcos_clock_hold(uint32_t mclk_hz);
+void arcos_clock_release(uint32_t mclk_hz);
+
+//registers a driver to be told about clock profile changes, the callback is not called for the current profile
+//registering a notifier that is already registered does nothing, so drivers can register from their init on every boot
+void arcos_clock_notify(struct arcos_clock_notifier_s * notifier, void (*callback)(uint8_t phase, uint32_t mclk_hz));
+
+//keeps SMCLK running while the kernel is idle, for a driver whose peripheral is clocked by SMCLK, e.g. SPI driven by DMA
+//the kernel idles in LPM0 instead of LPM3 until every hold is released, each hold must be released exactly once
+//holds do not survive arcos_resume(), like clock holds
+//safe to call from an ISR
+void arcos_lpm0_hold(void);
+void arcos_lpm0_release(void);
 
 //initial configuration of the core, sets up watchdog, clocks, timers, etc.
 //should be called immediately after boot
 void arcos_init(void);
 
+#if ARCOS_CONFIG_WARM_BOOT
+//call instead of arcos_init(), resumes the processes checkpointed the last time every process was blocked
+//returns true if they were restored, false if there was no valid checkpoint and arcos_init() was run instead
+//kernel objects and process structures must be persistent, see arcos_config.h
+bool arcos_resume(void);
+#endif
+
 //hands execution over to ARCOS
 //will never return, and current stack is invalidated
 void arcos_start(void);
@@ -5,18 +5,106 @@ Andrew R. Courtemanche 2020/12
 #ifndef ARCOS_CONFIG_GUARD
 #define ARCOS_CONFIG_GUARD
 
-#ifndef __MSP430FR6989__
-    #error No supported microcontroller detected.
+#if !defined(__MSP430FR6989__) && !defined(ARCOS_PORT_POSIX)
+    #error No supported microcontroller detected, define ARCOS_PORT_POSIX to build the host port.
+#endif
+
+#ifdef ARCOS_PORT_POSIX
+    //the host port runs processes on ucontext stacks, signal handlers and libc need far more stack than the target
+    #ifndef ARCOS_CONFIG_PROC_STACK_SIZE_MAX
+        #define ARCOS_CONFIG_PROC_STACK_SIZE_MAX (32768)
+    #endif
+    #ifndef ARCOS_CONFIG_STACK_POOL_SRAM_SIZE
+        #define ARCOS_CONFIG_STACK_POOL_SRAM_SIZE (4 * 32768)
+    #endif
+    #ifndef ARCOS_CONFIG_CONTEXT_16BIT
+        #define ARCOS_CONFIG_CONTEXT_16BIT (0)
+    #endif
+    #if ARCOS_CONFIG_CONTEXT_16BIT != 0
+        #error ARCOS_CONFIG_CONTEXT_16BIT is not supported by the host port
+    #endif
+    #if defined(ARCOS_CONFIG_WARM_BOOT) && ARCOS_CONFIG_WARM_BOOT
+        #error ARCOS_CONFIG_WARM_BOOT is not supported by the host port, process memory does not survive a restart
+    #endif
 #endif
 
 #ifndef ARCOS_CONFIG_TIMESLICE_MICROSECONDS
-    #define ARCOS_CONFIG_TIMESLICE_MICROSECONDS (1000) //1ms //UNUSED
+    #define ARCOS_CONFIG_TIMESLICE_MICROSECONDS (1000) //1ms, default quantum of every process, at most 26214us
+#endif
+#ifndef ARCOS_CONFIG_CONTEXT_16BIT
+    #define ARCOS_CONFIG_CONTEXT_16BIT (0) //0 saves 20-bit registers, 1 lets each process opt in to 16-bit saves, 2 saves 16-bit registers for every process
+#endif
+#ifndef ARCOS_CONFIG_PLACE_SRAM
+    #define ARCOS_CONFIG_PLACE_SRAM (0) //0 keeps kernel state in FRAM, 1 moves kernel state and the kernel stack to SRAM, 2 also runs the context switch and kernel ISRs from SRAM
+    //1 and 2 need msp430fr6989.ld edited to include arcos_sections.ld, with 2 the hot code shares SRAM with the SRAM stack pool, shrink the pool if it does not fit
+    //1 and 2 also need ARCOS_CONFIG_PRIO_SHIFT of at least 1, the ready list of 256 levels alone takes 1KB of the 2KB of SRAM
+#endif
+#ifndef ARCOS_CONFIG_STACK_CHECK
+    #define ARCOS_CONFIG_STACK_CHECK (1) //paint stacks and check guard words on every context switch, define as 0 for release builds
+#endif
+#ifndef ARCOS_CONFIG_STATS
+    #define ARCOS_CONFIG_STATS (1) //1 keeps per-process run time, dispatch, yield and preemption counters
+#endif
+#ifndef ARCOS_CONFIG_PERIODIC
+    #define ARCOS_CONFIG_PERIODIC (1) //1 enables periodic processes with deadlines, see arcos_proc_set_periodic()
+#endif
+#ifndef ARCOS_CONFIG_SCHED_EDF
+    #define ARCOS_CONFIG_SCHED_EDF (0) //orders periodic processes within a priority level by 0 relative deadline, 1 absolute deadline (EDF)
+#endif
+#ifndef ARCOS_CONFIG_AGING_MS
+    #define ARCOS_CONFIG_AGING_MS (0) //a ready process that waits this long is raised to priority 0, bounding starvation, 0 disables aging
+#endif
+#ifndef ARCOS_CONFIG_WARM_BOOT
+    #define ARCOS_CONFIG_WARM_BOOT (0) //1 checkpoints the kernel to FRAM whenever it goes idle so arcos_resume() can continue after a reset
+    //the checkpoint is only taken when something changed since the last one and runs with interrupts enabled, it costs two images of ~3KB of FRAM each,
+    //  ~2KB with ARCOS_CONFIG_PRIO_SHIFT 3, see arcos_os_boot_save() for an estimate of the time it takes
+#endif
+#ifndef ARCOS_CONFIG_CLOCK_MHZ_MAX
+    #define ARCOS_CONFIG_CLOCK_MHZ_MAX (16) //fastest MCLK arcos_clock_set_profile() accepts, 21 or 24 overclock the MSP430FR6989 beyond its datasheet rating
+#endif
+#ifndef ARCOS_CONFIG_TRACE_SIZE
+    #define ARCOS_CONFIG_TRACE_SIZE (64) //number of 4-byte records in the scheduler trace ring buffer, must be a power of 2, 0 disables tracing
+#endif
+#ifndef ARCOS_CONFIG_WATCHDOG_ENABLE
+    #define ARCOS_CONFIG_WATCHDOG_ENABLE (0) //1 resets the MCU if the scheduler does not dispatch a process for 1s
 #endif
 #ifndef ARCOS_CONFIG_PROC_COUNT_MAX
     #define ARCOS_CONFIG_PROC_COUNT_MAX (8)
 #endif
+#ifndef ARCOS_CONFIG_PRIO_SHIFT
+    #define ARCOS_CONFIG_PRIO_SHIFT (0) //priority 0-255 is shifted right by this to get a ready level, 0 gives 256 levels, 3 gives 32 levels
+    //above 0, priorities that share a level no longer preempt each other but round-robin, each level costs one 4-byte ready list pointer in
+    //  the kernel state, at 0 that is 1KB, which does not fit in SRAM with ARCOS_CONFIG_PLACE_SRAM and adds 2KB to the warm boot images
+#endif
+#if (ARCOS_CONFIG_TRACE_SIZE & (ARCOS_CONFIG_TRACE_SIZE - 1)) != 0
+    #error ARCOS_CONFIG_TRACE_SIZE must be a power of 2
+#endif
+#if (ARCOS_CONFIG_AGING_MS < 0) || (ARCOS_CONFIG_AGING_MS > 60000)
+    #error ARCOS_CONFIG_AGING_MS must be between 0 and 60000
+#endif
+#if ARCOS_CONFIG_CLOCK_MHZ_MAX < 16
+    #error ARCOS_CONFIG_CLOCK_MHZ_MAX must be at least 16, the profile set by arcos_init()
+#endif
+#if ARCOS_CONFIG_SCHED_EDF && !ARCOS_CONFIG_PERIODIC
+    #error ARCOS_CONFIG_SCHED_EDF requires ARCOS_CONFIG_PERIODIC
+#endif
+#if (ARCOS_CONFIG_PLACE_SRAM < 0) || (ARCOS_CONFIG_PLACE_SRAM > 2)
+    #error ARCOS_CONFIG_PLACE_SRAM must be 0, 1 or 2
+#endif
+#if (ARCOS_CONFIG_CONTEXT_16BIT < 0) || (ARCOS_CONFIG_CONTEXT_16BIT > 2)
+    #error ARCOS_CONFIG_CONTEXT_16BIT must be 0, 1 or 2
+#endif
+#if (ARCOS_CONFIG_PRIO_SHIFT < 0) || (ARCOS_CONFIG_PRIO_SHIFT > 8)
+    #error ARCOS_CONFIG_PRIO_SHIFT must be between 0 and 8
+#endif
 #ifndef ARCOS_CONFIG_PROC_STACK_SIZE_MAX
-    #define ARCOS_CONFIG_PROC_STACK_SIZE_MAX (1024)
+    #define ARCOS_CONFIG_PROC_STACK_SIZE_MAX (1024) //stack size used by arcos_proc_create()
+#endif
+#ifndef ARCOS_CONFIG_STACK_POOL_FRAM_SIZE
+    #define ARCOS_CONFIG_STACK_POOL_FRAM_SIZE (ARCOS_CONFIG_PROC_COUNT_MAX * ARCOS_CONFIG_PROC_STACK_SIZE_MAX) //bytes of FRAM for process stacks
+#endif
+#ifndef ARCOS_CONFIG_STACK_POOL_SRAM_SIZE
+    #define ARCOS_CONFIG_STACK_POOL_SRAM_SIZE (512) //bytes of SRAM for process stacks, 0 disables the SRAM pool
 #endif
 
 #ifdef __MSP430FR6989__
@@ -32,6 +120,20 @@ Andrew R. Courtemanche 2020/12
     #define ARCOS_CONFIG_CLOCK_SRC_FREQ_VLO (10000)
     #define ARCOS_CONFIG_CLOCK_SRC_FREQ_MOD (5000000)
     #define ARCOS_CONFIG_CLOCK_SRC_FREQ_LFMOD (ARCOS_CONFIG_CLOCK_FREQ_MOD/128)
+
+    #define ARCOS_CONFIG_CLOCK_FREQ_SMCLK (ARCOS_CONFIG_CLOCK_SRC_FREQ_MOD/2) //MODCLK/2, also the LED SPI bit clock
+    #define ARCOS_CONFIG_TICK_HZ (ARCOS_CONFIG_CLOCK_SRC_FREQ_LFXT) //kernel time base, Timer1_A counts ACLK directly so it keeps running in LPM3
+#endif
+
+#ifdef ARCOS_PORT_POSIX
+    #define ARCOS_CONFIG_KERNEL_SIZE_STACK (16) //the kernel runs on the stack of arcos_start()
+
+    #define ARCOS_CONFIG_CLOCK_FREQ_SMCLK (1000000) //timeslices are counted in microseconds
+    #define ARCOS_CONFIG_TICK_HZ (32768) //same kernel tick as the target, derived from CLOCK_MONOTONIC
+#endif
+
+#if (ARCOS_CONFIG_TIMESLICE_MICROSECONDS < 1) || (((ARCOS_CONFIG_TIMESLICE_MICROSECONDS * (ARCOS_CONFIG_CLOCK_FREQ_SMCLK / 1000)) / 1000) > 65536)
+    #error ARCOS_CONFIG_TIMESLICE_MICROSECONDS does not fit the 16-bit timeslice timer
 #endif
 
 #endif //end ARCOS_CONFIG_GUARD
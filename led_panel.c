@@ -27,6 +27,22 @@ RGB 11111111 00000000 10101010 would be encoded as:
 10010010 01001001 00100100 11011011 01101101 10110110 11010011 01001101 00110100
 G        G        G        R        R        R        B        B        B
 Keep in mind RGB is converted to GRB for transmission.
+
+The bit clock comes from SMCLK, which ARCOS keeps on MODCLK in every clock profile, so the timing above does not change with
+arcos_clock_set_profile().
+
+With LED_PANEL_PREENCODE the whole frame is encoded into led_tx, 4608 bytes per channel, before anything is sent. Each channel
+is then one single-transfer DMA of LED_TX_BYTES bytes triggered by UCTXIFG, so the CPU is not involved until the frame is done
+and interrupts stay enabled. led_draw_async() returns as soon as the DMA is started, the DMA interrupt ends each channel and
+reports the finished frame, so processes keep running, and the next frame can be rendered, while this one is sent. The DMA
+still needs MCLK to move each byte, so MCLK is held at LED_MCLK_MIN_HZ or faster until the frame is done, whatever profile
+the application sets meanwhile.
+
+led_fb_back() and led_present() give the framebuffer the application draws into. led_present() encodes it into led_tx before
+it returns and the DMA only reads led_tx, so one framebuffer is enough: the next frame is drawn into it while this one is sent.
+
+Without it, each pixel is encoded while the DMA sends the previous one, which must finish within the 28.8us it takes to send
+9 bytes, so interrupts are disabled for the whole frame and MCLK must be at least LED_MCLK_MIN_HZ.
 */
 
 #include "led_panel.h"
@@ -35,10 +51,38 @@ Keep in mind RGB is converted to GRB for transmission.
 #define ARC_MSP_TYPE_msp430fr6989
 #include "arc_msp_helper.h"
 
+#include "arcos.h"
+
 #include <msp430.h>
 #include <stdint.h>
 #include <stdbool.h>
 
+#if LED_PANEL_PREENCODE
+//encoded frame for each channel, too large for SRAM, the DMA reads it from FRAM
+__attribute__ ((lower))
+__attribute__ ((persistent))
+uint8_t led_tx[2][LED_TX_BYTES] = {{0}};
+
+#define LED_TRACE_ISR (5) //trace id of the DMA ISR, after the port ISRs
+#define LED_EVENT_DONE (0x0001)
+
+//slowest MCLK at which the DMA keeps both TXBUFs fed, each channel needs a byte every 3.2us and every transfer takes
+//  MCLK cycles from the CPU, the margin above the ~3MHz where they start to underrun covers the FRAM reads and ISRs
+#define LED_MCLK_MIN_HZ (4000000)
+
+//transfer state, persistent along with the processes that may be waiting on it, see led_resume()
+__attribute__ ((lower))
+__attribute__ ((persistent))
+volatile uint8_t led_busy = 0; //bit n is set while channel n is sending
+__attribute__ ((lower))
+__attribute__ ((persistent))
+struct arcos_event_s led_event = {0}; //set by the DMA ISR when a frame is done
+void (*led_callback)(void); //called by the DMA ISR when the frame in flight is done
+#else
+//slowest MCLK that encodes a pixel before the DMA finishes sending the previous one
+#define LED_MCLK_MIN_HZ (16000000)
+#endif
+
 //LUT for first TX byte
 __attribute__ ((lower))
 const uint8_t led_TX_LUT0[] = {
@@ -165,9 +209,17 @@ static inline void led_RGB_to_TX(uint8_t * buf, uint8_t * rgb) {
     buf[8] = led_TX_LUT2[rgb[2]];
 }
 
+//the framebuffer, too large for SRAM, persistent so a process restored by arcos_resume() keeps what it drew
+__attribute__ ((lower))
+__attribute__ ((persistent))
+uint8_t led_fb[LED_PANEL_WIDTH*LED_PANEL_HEIGHT*3] = {0};
+
 //make sure LED strips have enough time to reset
 //writes a bunch of zero bytes to panel
 void led_flush(void) {
+#if LED_PANEL_PREENCODE
+    led_wait();
+#endif
     for (uint16_t i=0; i<100; i++) {
         while (!(UCB0IFG & UCTXIFG));
         UCB0TXBUF = 0;
@@ -176,8 +228,119 @@ void led_flush(void) {
     }
 }
 
+#if LED_PANEL_PREENCODE
+//encodes both channels in the order the panel is wired, flipping the odd rows
+void led_encode(uint8_t * rgb_buf) {
+    for (uint_fast8_t ch=0; ch<2; ch++) {
+        uint8_t * tx = led_tx[ch];
+        uint8_t * rgb = &rgb_buf[ch * ((LED_CHANNEL_WIDTH*LED_CHANNEL_HEIGHT)*3)];
+        for (uint16_t y=0; y<LED_CHANNEL_HEIGHT; y++) {
+            for (uint16_t x=0; x<LED_CHANNEL_WIDTH; x++) {
+                uint16_t col = ((y & 0x1) == 0) ? x : (LED_CHANNEL_WIDTH-1-x);
+                led_RGB_to_TX(tx, &rgb[(col+(y*LED_CHANNEL_WIDTH)) * 3]);
+                tx += 9;
+            }
+        }
+    }
+}
+
+//ends the transfer of a channel, runs in the DMA ISR
+//the DMA finishes when it writes the last byte into TXBUF, so the trailing 0 waits for that byte to move to the shift register
+static void led_channel_done(uint8_t channel) {
+    if (channel == 0) {
+        while (!(UCB0IFG & UCTXIFG));
+        UCB0TXBUF = 0; //start resetting the panel
+    } else {
+        while (!(UCB1IFG & UCTXIFG));
+        UCB1TXBUF = 0; //start resetting the panel
+    }
+    led_busy &= ~(1 << channel);
+    if (led_busy == 0) {
+        arcos_lpm0_release();
+        arcos_clock_release(LED_MCLK_MIN_HZ); //drops MCLK back to the profile the application set, if it was raised
+        if (led_callback != NULL) {
+            led_callback();
+        }
+        arcos_event_set(&led_event, LED_EVENT_DONE);
+    }
+}
+
+//DMA0 and DMA1 finished sending their channel
+__attribute__ ((interrupt(DMA_VECTOR)))
+static void led_isr_dma(void) {
+    arcos_trace_isr_enter(LED_TRACE_ISR);
+    switch (DMAIV) { //reading DMAIV clears the highest pending flag, the ISR runs again for the other one
+        case DMAIV_DMA0IFG:
+            led_channel_done(0);
+            break;
+        case DMAIV_DMA1IFG:
+            led_channel_done(1);
+            break;
+        default:
+            break;
+    }
+    arcos_trace_isr_exit(LED_TRACE_ISR);
+}
+
+//blocks without using any CPU time until the frame in flight, if any, is done
+//arcos_event_wait() clears the flag for the first waiter to run, so each waiter sets it again on the way out for any other
+//  process waiting on the same frame, a flag left set by the last one only costs a later led_wait() one extra pass
+void led_wait(void) {
+    if (led_busy == 0) {
+        return;
+    }
+    while (led_busy != 0) {
+        arcos_event_wait(&led_event, LED_EVENT_DONE); //may return for an older frame, so led_busy is checked again
+    }
+    arcos_event_set(&led_event, LED_EVENT_DONE); //wakes the next waiter of this frame
+}
+
+//starts both channels on their whole buffer
+//DMA has priority over the CPU, so interrupts and context switches during the transfer do not disturb the bit timing
+static void led_send(void) {
+    while (!(UCB0IFG & UCTXIFG)); //make sure nothing is being transmitted already
+    while (!(UCB1IFG & UCTXIFG)); //make sure nothing is being transmitted already
+
+    DMA0SA = (uintptr_t) &led_tx[0][0];
+    DMA1SA = (uintptr_t) &led_tx[1][0];
+    DMA0SZ = LED_TX_BYTES;
+    DMA1SZ = LED_TX_BYTES;
+    led_busy = 0x3;
+    arcos_lpm0_hold(); //the SPI runs on SMCLK, which stops in LPM3
+    arcos_clock_hold(LED_MCLK_MIN_HZ); //the DMA falls behind the SPI below it
+
+    //enable DMA and provide rising edge to kick it off
+    //both channels are started with interrupts disabled so neither can fall behind the other by more than a few bytes
+    uint16_t GIE_BACKUP = _get_SR_register() & GIE; //store GIE
+    __asm(" DINT \n NOP \n"); //disable interrupts
+    DMA0CTL |= DMAEN;
+    UCB0IFG &= ~UCTXIFG;
+    UCB0IFG |=  UCTXIFG;
+    DMA1CTL |= DMAEN;
+    UCB1IFG &= ~UCTXIFG;
+    UCB1IFG |=  UCTXIFG;
+    __asm(" BIS.B %0, SR \n NOP \n"::"r"(GIE_BACKUP)); //restore GIE
+}
+
+//waits for the previous frame, since its encoded bytes are overwritten, then encodes and starts this one
+void led_draw_async(uint8_t * rgb_buf, void (*callback)(void)) {
+    led_wait();
+    led_encode(rgb_buf);
+    led_callback = callback;
+    led_send();
+}
+
 //draw given 32x32 24 bit RGB framebuffer
 void led_draw(uint8_t * rgb_buf) {
+    led_draw_async(rgb_buf, NULL);
+    led_wait();
+}
+#else
+//draw given 32x32 24 bit RGB framebuffer
+//raises MCLK for the frame if the current clock profile is too slow to keep up with the DMA
+void led_draw(uint8_t * rgb_buf) {
+    arcos_clock_hold(LED_MCLK_MIN_HZ);
+
     uint16_t GIE_BACKUP = _get_SR_register() & GIE; //store GIE
     __asm(" DINT \n NOP \n"); //disable interrupts
 
@@ -260,10 +423,26 @@ void led_draw(uint8_t * rgb_buf) {
     __asm(" NOP \n");
     //_enable_interrupts();
     __asm(" BIS.B %0, SR \n NOP \n"::"r"(GIE_BACKUP)); //restore GIE
+
+    arcos_clock_release(LED_MCLK_MIN_HZ); //does nothing to MCLK if it was not raised
 }
 
-//initialize required registers
-void led_init(void) {
+//the frame is sent before this returns, so the callback runs here rather than in an ISR
+void led_draw_async(uint8_t * rgb_buf, void (*callback)(void)) {
+    led_draw(rgb_buf);
+    led_flush();
+    if (callback != NULL) {
+        callback();
+    }
+}
+
+//nothing is ever in flight
+void led_wait(void) {
+}
+#endif
+
+//initialize required registers, everything here is lost on reset
+static void led_hw_init(void) {
     //P1.6 UCB0SIMO
     //P4.0 UCB1SIMO
     arc_msp_setup(); //setup GPIO
@@ -300,4 +479,42 @@ void led_init(void) {
 
     DMA0SZ = 9; //transfer 9 bytes
     DMA1SZ = 9; //transfer 9 bytes
+
+#if LED_PANEL_PREENCODE
+    DMA0CTL |= DMAIE; //each channel ends in led_isr_dma()
+    DMA1CTL |= DMAIE;
+#endif
+}
+
+//returns the framebuffer to draw the next frame into
+uint8_t * led_fb_back(void) {
+    return &led_fb[0];
+}
+
+//draws the framebuffer, see led_draw_async(), which is done with it once it returns
+//it still holds the frame presented, it is not cleared
+void led_present(void (*callback)(void)) {
+    led_draw_async(&led_fb[0], callback);
+}
+
+//initialize required registers
+void led_init(void) {
+    led_hw_init();
+#if LED_PANEL_PREENCODE
+    led_busy = 0;
+    arcos_event_init(&led_event);
+#endif
+}
+
+//initialize required registers after arcos_resume(), keeps led_event and any process waiting on it
+//a frame in flight was cut off by the reset, it is ended here so its waiters are released
+//arcos_resume() has already dropped the LPM0 and clock holds it took
+void led_resume(void) {
+    led_hw_init();
+#if LED_PANEL_PREENCODE
+    if (led_busy != 0) {
+        led_busy = 0;
+        arcos_event_set(&led_event, LED_EVENT_DONE);
+    }
+#endif
 }
@@ -12,13 +12,43 @@ Andrew R. Courtemanche 2020/12
 #define LED_CHANNEL_WIDTH 32
 #define LED_CHANNEL_HEIGHT 16
 
+#ifndef LED_PANEL_PREENCODE
+    #define LED_PANEL_PREENCODE (1) //1 encodes the whole frame into FRAM and sends each channel with one DMA transfer, 0 encodes each pixel while the previous one is sent
+#endif
+#define LED_TX_BYTES (LED_CHANNEL_WIDTH*LED_CHANNEL_HEIGHT*9) //encoded bytes per channel
+
 //initialize required registers
 void led_init(void);
 
+//initialize required registers after arcos_resume() returned true, keeps the state of the driver that survived the reset
+void led_resume(void);
+
 //make sure LED strips have enough time to reset
 void led_flush(void);
 
 //draw given 32x32 24 bit RGB framebuffer
 void led_draw(uint8_t * rgb_buf);
 
+#if LED_PANEL_PREENCODE
+//encodes a 32x32 24 bit RGB framebuffer into the transmit buffer, runs with interrupts enabled
+//must not be called while a frame is being sent, see led_wait()
+void led_encode(uint8_t * rgb_buf);
+
+#endif
+
+//starts drawing the given framebuffer and returns without waiting for it to be sent, the framebuffer can be reused right away
+//waits for the previous frame first, callback runs in the DMA ISR once this frame is sent, can be NULL
+//without LED_PANEL_PREENCODE this is led_draw() and led_flush(), then the callback
+void led_draw_async(uint8_t * rgb_buf, void (*callback)(void));
+
+//blocks the calling process until the frame being sent, if any, is done, any number of processes may wait at once
+void led_wait(void);
+
+//returns the framebuffer of the driver, 32x32 24 bit RGB, to draw the next frame into
+uint8_t * led_fb_back(void);
+
+//starts drawing the framebuffer of led_fb_back(), callback as in led_draw_async()
+//returns once the frame is encoded, the next frame can be drawn into led_fb_back() while this one is sent
+void led_present(void (*callback)(void));
+
 #endif //end include guard
@@ -21,48 +21,74 @@ Andrew R. Courtemanche 2020/12
 #define LEFT_BTN &P(1,1)
 #define RIGHT_BTN &P(1,2)
 
-__attribute__ ((used))
-__attribute__ ((noinline))
-void process1(void) {
-    while (true) {
-        if (digitalRead(RIGHT_BTN) == LOW) {
-            digitalWrite(GREEN_LED, HIGH);
-        } else {
-            digitalWrite(GREEN_LED, LOW);
-        }
-        arcos_proc_yield();
+//button event flags
+#define BTN_EVENT_RIGHT (0x0001)
+#define BTN_EVENT_LEFT (0x0002)
+
+//set by the port ISR when a button changes, placed in FRAM to keep SRAM clear
+//kernel objects are persistent so a process blocked on one is still blocked on it after a warm boot
+__attribute__ ((lower))
+__attribute__ ((persistent))
+struct arcos_event_s btn_event = {0};
+
+//mirrors a button on an LED, then flips the interrupt edge so both press and release set the event
+static void button_update(const struct portPin_s * btn, const struct portPin_s * led, uint16_t bit) {
+    if (digitalRead(btn) == LOW) {
+        digitalWrite(led, HIGH);
+        pinInterruptEvent(btn, ENABLE, RISING_EDGE, &btn_event, bit); //wait for release
+        if (digitalRead(btn) == HIGH) arcos_event_set(&btn_event, bit); //released while the edge was changed
+    } else {
+        digitalWrite(led, LOW);
+        pinInterruptEvent(btn, ENABLE, FALLING_EDGE, &btn_event, bit); //wait for press
+        if (digitalRead(btn) == LOW) arcos_event_set(&btn_event, bit); //pressed while the edge was changed
     }
 }
 
+//sleeps until either button changes, the port ISR only sets a flag so all of the work runs here
 __attribute__ ((used))
 __attribute__ ((noinline))
-void process2(void) {
+void process_buttons(void) {
     while (true) {
-        if (digitalRead(LEFT_BTN) == LOW) {
-            digitalWrite(RED_LED, HIGH);
-        } else {
-            digitalWrite(RED_LED, LOW);
-        }
-        arcos_proc_yield();
+        uint16_t bits = arcos_event_wait(&btn_event, BTN_EVENT_RIGHT | BTN_EVENT_LEFT);
+        if (bits & BTN_EVENT_RIGHT) button_update(RIGHT_BTN, GREEN_LED, BTN_EVENT_RIGHT);
+        if (bits & BTN_EVENT_LEFT) button_update(LEFT_BTN, RED_LED, BTN_EVENT_LEFT);
     }
 }
 
-//this is too large to fit in SRAM, so it is put in FRAM
-__attribute__ ((lower))
-__attribute__ ((persistent)) //by default, __attribute__ ((lower)) will place in SRAM, linking fails if this is not present
-uint8_t fb[LED_PANEL_WIDTH*LED_PANEL_HEIGHT*3] = {0};
-
-void fb_clear(void) {
-    for(uint16_t i=0; i<sizeof(fb); i++) {
+//the framebuffer is owned by the LED driver, see led_fb_back()
+void fb_clear(uint8_t * fb) {
+    for(uint16_t i=0; i<LED_PANEL_WIDTH*LED_PANEL_HEIGHT*3; i++) {
         fb[i] = 0;
     }
 }
 
+#define RENDER_FRAME_MS 75 //time between the start of each frame, each frame is one job of a periodic process
+
+//kernel ticks from arcos_init() or arcos_resume() returning to the end of the first frame, [0] for the last cold boot, [1] for the last warm boot
+//read with the debugger, does not include the C startup code before main()
+__attribute__ ((lower))
+__attribute__ ((persistent))
+uint32_t boot_report[2] = {0};
+uint32_t boot_tick; //kernel time when main() finished init
+bool boot_warm;
+bool frame_seen; //in SRAM, so it is false after every reset
+
+//records the boot to first frame time once per boot, called from the LED DMA ISR when a frame is sent
+static void boot_report_frame(void) {
+    if (!frame_seen) {
+        frame_seen = true;
+        boot_report[boot_warm] = arcos_tick_now() - boot_tick;
+    }
+}
+
 __attribute__((used))
 __attribute__ ((noinline))
 void process_render(void) {
+    uint8_t * fb;
     while (true) {
-        fb_clear();
+        arcos_clock_set_profile(ARCOS_CLOCK_16MHZ); //full speed while rendering
+        fb = led_fb_back(); //the previous frame may still be sending, from its encoded copy, so the framebuffer is free
+        fb_clear(fb);
         //fill fb with gradient
         for (uint16_t x=0; x<LED_PANEL_WIDTH; x++){
             for (uint16_t y=0; y<LED_PANEL_HEIGHT; y++){
@@ -71,12 +97,13 @@ void process_render(void) {
                 fb[((x + (y*LED_PANEL_WIDTH))*3) + 2] += 0;
             }
         }
-        arcos_proc_yield();
-        led_draw(&fb[0]);
-        led_flush();
-        for(volatile uint32_t delay = 100000; delay>0; delay--); //adds arbitrary delay
+        led_present(&boot_report_frame); //sent while this process sleeps, rendering the next frame takes longer than the reset time so no flush is needed
+        arcos_clock_set_profile(ARCOS_CLOCK_1MHZ); //the button process is all that can run until the next frame, the LED driver holds MCLK up until the frame is sent
+        arcos_proc_wait_period(); //sleep for the rest of the frame, the kernel counts frames that finish late
 
-        fb_clear();
+        arcos_clock_set_profile(ARCOS_CLOCK_16MHZ);
+        fb = led_fb_back();
+        fb_clear(fb);
         //fill fb with opposite gradient
         for (uint16_t x=0; x<LED_PANEL_WIDTH; x++){
             for (uint16_t y=0; y<LED_PANEL_HEIGHT; y++){
@@ -85,26 +112,25 @@ void process_render(void) {
                 fb[((x + (y*LED_PANEL_WIDTH))*3) + 2] += 0;
             }
         }
-        arcos_proc_yield();
-        led_draw(&fb[0]);
-        led_flush();
-        for(volatile uint32_t delay = 100000; delay>0; delay--); //adds arbitrary delay
+        led_present(&boot_report_frame);
+        arcos_clock_set_profile(ARCOS_CLOCK_1MHZ);
+        arcos_proc_wait_period(); //sleep for the rest of the frame, the kernel counts frames that finish late
     }
 }
 
-//place in upper FRAM, not SRAM to keep SRAM clear
-__attribute__ ((upper))
-struct arcos_proc_s process1_s;
-__attribute__ ((upper))
-struct arcos_proc_s process2_s;
-__attribute__ ((upper))
-struct arcos_proc_s process_render_s;
-__attribute__ ((upper))
-struct arcos_proc_s process_startup_s;
+//place in FRAM, not SRAM to keep SRAM clear, persistent so arcos_resume() can restore them
+__attribute__ ((lower))
+__attribute__ ((persistent))
+struct arcos_proc_s process_buttons_s = {0};
+__attribute__ ((lower))
+__attribute__ ((persistent))
+struct arcos_proc_s process_render_s = {0};
+__attribute__ ((lower))
+__attribute__ ((persistent))
+struct arcos_proc_s process_startup_s = {0};
 
-__attribute__((used))
-__attribute__ ((noinline))
-void process_startup(void) {
+//pin setup, port registers are reset on every boot
+static void board_init(void) {
     //red LED init
     pinMode(RED_LED, MODE_OUTPUT);
     digitalWrite(RED_LED, LOW);
@@ -118,29 +144,47 @@ void process_startup(void) {
 
     //right BTN init
     pinMode(RIGHT_BTN, MODE_INPUT_PULLUP);
+}
 
-    //zero out RAM, nothing should be using it. This is mostly just as a demonstration that this is running within FRAM now.
-    //0x001C00-0x0023FF RAM
-    for (uint16_t i=0x1C00; i<=0x0023FF; i++) {
-        *((uint8_t *)i) = 0;
-    }
-
-    arcos_proc_create(&process1_s, &process1, 0, 100); //automatic stack allocation, 100 priority
-    arcos_proc_start(&process1_s);
-    arcos_proc_create(&process2_s, &process2, 0, 100); //automatic stack allocation, 100 priority
-    arcos_proc_start(&process2_s);
-    arcos_proc_create(&process_render_s, &process_render, 0x2400, 100); //place this process in SRAM (0x2400 is the top of SRAM), 100 priority
+__attribute__((used))
+__attribute__ ((noinline))
+void process_startup(void) {
+    //the button process starts by reading the current state of both buttons, which also arms the first interrupts
+    arcos_event_init(&btn_event);
+    arcos_event_set(&btn_event, BTN_EVENT_RIGHT | BTN_EVENT_LEFT);
+
+    arcos_proc_create_stack(&process_buttons_s, &process_buttons, 192, ARCOS_STACK_POOL_FRAM, 100); //small FRAM stack, 100 priority
+    arcos_proc_start(&process_buttons_s);
+    arcos_proc_create_stack(&process_render_s, &process_render, 384, ARCOS_STACK_POOL_SRAM, 150); //place this process in SRAM, 150 priority
+    //below the button process, a periodic process is put at the head of its level and not rotated by arcos_proc_yield(), so sharing a level would starve the buttons for each frame
+    arcos_proc_set_quantum(&process_render_s, 5000); //rendering is batch work, give it longer slices
+    arcos_proc_set_periodic(&process_render_s, ARCOS_MS_TO_TICKS(RENDER_FRAME_MS), 0); //a frame must be drawn before the next one starts
     arcos_proc_start(&process_render_s);
     //Here, this process returns and terminates. It will not run again.
 }
 
 void main(void) {
+#if ARCOS_CONFIG_WARM_BOOT
+    boot_warm = arcos_resume();
+#else
     arcos_init();
+#endif
     arc_msp_setup();
-    led_init();
-
-    arcos_proc_create(&process_startup_s, &process_startup, 0, 0); //automatic stack allocation, 0 (maximum) priority
-    arcos_proc_start(&process_startup_s);
+    if (boot_warm) {
+        led_resume();
+    } else {
+        led_init();
+    }
+    board_init();
+    boot_tick = arcos_tick_now();
+
+    if (boot_warm) {
+        //the processes continue where they were, pin interrupts were lost with the reset so the button process rereads both buttons and rearms them
+        arcos_event_set(&btn_event, BTN_EVENT_RIGHT | BTN_EVENT_LEFT);
+    } else {
+        arcos_proc_create(&process_startup_s, &process_startup, 0, 0); //automatic stack allocation, 0 (maximum) priority
+        arcos_proc_start(&process_startup_s);
+    }
 
     arcos_start();
 }
@@ -0,0 +1,354 @@
+/*
+Scheduler benchmark for the ARCOS host port, runs the same scheduling code as the target on Linux
+
+build and run from the repository root:
+    gcc -std=gnu99 -O2 -Wall -Wno-attributes -DARCOS_PORT_POSIX -I. tools/arcos_bench.c arcos.c -o arcos_bench && ./arcos_bench
+
+measures:
+    throughput  - context switches per second between processes that only yield
+    fairness    - CPU share of equal priority processes that never yield, and Jain's fairness index
+    starvation  - CPU share left to a low priority process by a higher priority process that never blocks,
+                  and by one that sleeps for part of every period, and the longest the low priority process went
+                  without the CPU, add -DARCOS_CONFIG_AGING_MS=100 to bound it
+    pipeline    - latency from a producer sending an item to its consumer receiving it, while a busy process shares their
+                  priority, handing off with arcos_proc_yield() and with arcos_proc_yield_to()
+    periodic    - deadline misses and worst case response of two periodic processes on one level at 84% utilization,
+                  which deadline monotonic order cannot schedule and EDF can, add -DARCOS_CONFIG_SCHED_EDF=1 to compare
+
+checks, each prints FAIL and makes the benchmark exit with EXIT_FAILURE, bounds leave room for host scheduling noise:
+    throughput  - at least BENCH_SWITCHES_MIN switches per second
+    fairness    - Jain index of at least 0.99
+    starvation  - the busy high process gets at least 95% of the CPU, or with aging the low process waits at most
+                  ARCOS_CONFIG_AGING_MS + BENCH_SLACK_MS, and behind the sleepy process it waits at most BENCH_SLACK_MS
+    pipeline    - at least one item per 5ms arrives, and arcos_proc_yield_to() keeps the mean latency under 1ms
+    periodic    - at most BENCH_MISSES_MAX missed deadlines for the shorter period, and for both under EDF
+*/
+
+#include "arcos.h"
+
+#if !ARCOS_CONFIG_STATS
+    #error tools/arcos_bench.c measures CPU shares with arcos_stats_snapshot(), it needs ARCOS_CONFIG_STATS
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define WORKER_COUNT (3)
+#define PHASE_MS (1000)
+
+#define PRIO_CONTROL (0)
+#define PRIO_HIGH (64)
+#define PRIO_WORKER (128)
+
+#define BENCH_SWITCHES_MIN (10000)
+#define BENCH_SLACK_MS (50)
+#define BENCH_MISSES_MAX (1) //a host stall longer than the slack, which happens every few dozen runs, costs one job its deadline
+
+struct arcos_proc_s control_s;
+struct arcos_proc_s worker_s[WORKER_COUNT];
+
+volatile uint32_t worker_count[WORKER_COUNT];
+volatile uint8_t worker_next;
+
+struct arcos_queue_s pipeline_queue;
+uint64_t pipeline_buffer[4];
+volatile bool pipeline_handoff;
+volatile uint64_t pipeline_latency_sum;
+volatile uint64_t pipeline_latency_max;
+volatile uint64_t starved_last;
+volatile uint64_t starved_max;
+bool bench_failed;
+
+//reports a failed check, the benchmark carries on so every result is printed
+static void bench_check(bool ok, const char * what) {
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        bench_failed = true;
+    }
+}
+
+static uint64_t bench_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t) now.tv_sec * 1000000000) + now.tv_nsec;
+}
+
+void worker_yield(void) {
+    uint8_t i = worker_next++;
+    while (true) {
+        worker_count[i]++;
+        arcos_proc_yield();
+    }
+}
+
+void worker_spin(void) {
+    uint8_t i = worker_next++;
+    while (true) {
+        worker_count[i]++;
+    }
+}
+
+//worker 1 of the starvation phase, spins and records the longest gap between two iterations, which is time without the CPU
+void worker_starved(void) {
+    worker_next++;
+    while (true) {
+        uint64_t now = bench_ns();
+        if (now - starved_last > starved_max) {
+            starved_max = now - starved_last;
+        }
+        starved_last = now;
+    }
+}
+
+//runs for 1 tick out of every 4
+void worker_sleepy(void) {
+    worker_next++;
+    uint32_t tick = arcos_tick_now();
+    while (true) {
+        uint32_t end = tick + 1;
+        while ((int32_t) (arcos_tick_now() - end) < 0);
+        tick += 4;
+        arcos_proc_sleep_until(tick);
+    }
+}
+
+//worker 0, sends the time once per millisecond then lets the consumer take it
+void worker_producer(void) {
+    worker_next++;
+    while (true) {
+        arcos_proc_sleep_ms(1);
+        uint64_t item = bench_ns();
+        arcos_queue_send(&pipeline_queue, &item);
+        if (!pipeline_handoff || !arcos_proc_yield_to(&worker_s[1])) {
+            arcos_proc_yield();
+        }
+    }
+}
+
+//worker 1
+void worker_consumer(void) {
+    uint64_t item;
+    worker_next++;
+    while (true) {
+        arcos_queue_receive(&pipeline_queue, &item);
+        uint64_t latency = bench_ns() - item;
+        pipeline_latency_sum += latency;
+        if (latency > pipeline_latency_max) {
+            pipeline_latency_max = latency;
+        }
+        worker_count[1]++;
+    }
+}
+
+#if ARCOS_CONFIG_PERIODIC
+//periodic jobs of worker 0 and 1, {period, execution time} in ms
+//just above the 83% bound of rate monotonic order, the longer job is preempted twice and misses by 2ms under deadline
+//  monotonic order, while EDF has ~20ms of slack on it, well above the ~10ms of host scheduling noise
+static const uint8_t periodic_ms[2][2] = {{100, 40}, {140, 62}};
+
+//run ticks of worker i, each worker has its own snapshot since a worker can be preempted while taking one
+static uint32_t worker_run_ticks(uint8_t i) {
+    static struct arcos_stats_s snapshot[WORKER_COUNT];
+    arcos_stats_snapshot(&snapshot[i]);
+    for (uint8_t j=0; j<snapshot[i].count; j++) {
+        if (snapshot[i].procs[j].handle == &worker_s[i]) {
+            return snapshot[i].procs[j].stats.run_ticks;
+        }
+    }
+    return 0;
+}
+
+//worker 0 and 1, each job spins for its execution time of CPU, not wall clock, time
+void worker_periodic(void) {
+    uint8_t i = worker_next++;
+    uint32_t exec = ARCOS_MS_TO_TICKS(periodic_ms[i][1]);
+    while (true) {
+        uint32_t start = worker_run_ticks(i);
+        while (worker_run_ticks(i) - start < exec);
+        worker_count[i]++;
+        arcos_proc_wait_period();
+    }
+}
+#endif
+
+//creates worker i, workers must be started in index order since each takes worker_next as its index
+static void worker_create(uint8_t i, void (*callback)(void), uint8_t priority) {
+    worker_count[i] = 0;
+    if (!arcos_proc_create_stack(&worker_s[i], callback, ARCOS_CONFIG_PROC_STACK_SIZE_MAX, ARCOS_STACK_POOL_FRAM, priority)) {
+        printf("could not create worker %u\n", i);
+        exit(EXIT_FAILURE);
+    }
+}
+
+//starts count workers with the same callback and priority
+static void workers_start(uint8_t count, void (*callback)(void)) {
+    worker_next = 0;
+    for (uint8_t i=0; i<count; i++) {
+        worker_create(i, callback, PRIO_WORKER);
+    }
+    for (uint8_t i=0; i<count; i++) {
+        arcos_proc_start(&worker_s[i]);
+    }
+}
+
+static void workers_stop(uint8_t count) {
+    for (uint8_t i=0; i<count; i++) {
+        arcos_proc_terminate(&worker_s[i]);
+    }
+}
+
+//run ticks of each worker between two snapshots
+static void workers_run_ticks(const struct arcos_stats_s * before, const struct arcos_stats_s * after, uint8_t count, uint32_t * ticks) {
+    for (uint8_t i=0; i<count; i++) {
+        ticks[i] = 0;
+        for (uint8_t j=0; j<after->count; j++) {
+            if (after->procs[j].handle == &worker_s[i]) {
+                ticks[i] = after->procs[j].stats.run_ticks;
+            }
+        }
+        for (uint8_t j=0; j<before->count; j++) {
+            if (before->procs[j].handle == &worker_s[i]) {
+                ticks[i] -= before->procs[j].stats.run_ticks;
+            }
+        }
+    }
+}
+
+static void phase_throughput(void) {
+    workers_start(WORKER_COUNT, &worker_yield);
+    uint32_t start = arcos_tick_now();
+    arcos_proc_sleep_ms(PHASE_MS);
+    uint32_t ticks = arcos_tick_now() - start;
+    uint64_t switches = 0;
+    for (uint8_t i=0; i<WORKER_COUNT; i++) {
+        switches += worker_count[i];
+    }
+    workers_stop(WORKER_COUNT);
+    printf("throughput: %llu yields in %.3fs, %.0f switches/s\n", (unsigned long long) switches, (double) ticks / ARCOS_CONFIG_TICK_HZ, (double) switches * ARCOS_CONFIG_TICK_HZ / ticks);
+    bench_check((double) switches * ARCOS_CONFIG_TICK_HZ / ticks >= BENCH_SWITCHES_MIN, "throughput below BENCH_SWITCHES_MIN");
+}
+
+static void phase_fairness(void) {
+    static struct arcos_stats_s before, after;
+    uint32_t ticks[WORKER_COUNT];
+    workers_start(WORKER_COUNT, &worker_spin);
+    arcos_stats_snapshot(&before);
+    arcos_proc_sleep_ms(PHASE_MS);
+    arcos_stats_snapshot(&after);
+    workers_stop(WORKER_COUNT);
+    workers_run_ticks(&before, &after, WORKER_COUNT, ticks);
+
+    double sum = 0, sum_sq = 0;
+    printf("fairness:");
+    for (uint8_t i=0; i<WORKER_COUNT; i++) {
+        printf(" %.1f%%", 100.0 * ticks[i] / (after.now - before.now));
+        sum += ticks[i];
+        sum_sq += (double) ticks[i] * ticks[i];
+    }
+    printf(", Jain index %.3f\n", (sum * sum) / (WORKER_COUNT * sum_sq));
+    bench_check((sum * sum) / (WORKER_COUNT * sum_sq) >= 0.99, "Jain index below 0.99");
+}
+
+//busy is true for a high priority process that never blocks
+static void phase_starvation(const char * name, void (*high)(void), bool busy) {
+    static struct arcos_stats_s before, after;
+    uint32_t ticks[2];
+    worker_next = 0;
+    worker_create(0, high, PRIO_HIGH);
+    worker_create(1, &worker_starved, PRIO_WORKER);
+    starved_max = 0;
+    starved_last = bench_ns();
+    arcos_proc_start(&worker_s[0]);
+    arcos_proc_start(&worker_s[1]);
+    arcos_stats_snapshot(&before);
+    arcos_proc_sleep_ms(PHASE_MS);
+    arcos_stats_snapshot(&after);
+    workers_stop(2);
+    if (bench_ns() - starved_last > starved_max) { //still waiting at the end of the phase
+        starved_max = bench_ns() - starved_last;
+    }
+    workers_run_ticks(&before, &after, 2, ticks);
+    printf("starvation, %s: high %.1f%%, low %.1f%%, low waited at most %.1fms\n", name, 100.0 * ticks[0] / (after.now - before.now), 100.0 * ticks[1] / (after.now - before.now),
+        starved_max / 1000000.0);
+    if (!busy) {
+        bench_check(starved_max <= BENCH_SLACK_MS * 1000000ull, "low priority process starved behind a process that sleeps");
+    } else if (ARCOS_CONFIG_AGING_MS > 0) {
+        bench_check(starved_max <= (ARCOS_CONFIG_AGING_MS + BENCH_SLACK_MS) * 1000000ull, "aging did not bound starvation");
+    } else {
+        bench_check(ticks[0] >= 0.95 * (after.now - before.now), "busy high priority process did not get 95% of the CPU");
+    }
+}
+
+static void phase_pipeline(bool handoff) {
+    arcos_queue_init(&pipeline_queue, pipeline_buffer, sizeof(pipeline_buffer[0]), 4);
+    pipeline_handoff = handoff;
+    worker_next = 0;
+    worker_create(0, &worker_producer, PRIO_WORKER);
+    worker_create(1, &worker_consumer, PRIO_WORKER);
+    worker_create(2, &worker_spin, PRIO_WORKER);
+    for (uint8_t i=0; i<3; i++) {
+        arcos_proc_start(&worker_s[i]);
+    }
+    pipeline_latency_sum = 0;
+    pipeline_latency_max = 0;
+    arcos_proc_sleep_ms(PHASE_MS);
+    uint32_t items = worker_count[1];
+    workers_stop(3);
+    printf("pipeline, %s: %lu items, latency mean %.1fus, max %.1fus\n", handoff ? "arcos_proc_yield_to" : "arcos_proc_yield", (unsigned long) items,
+        items ? (pipeline_latency_sum / 1000.0) / items : 0.0, pipeline_latency_max / 1000.0);
+    //~3ms per item with the busy process taking a full slice between items, the floor survives a host stall of ~350ms
+    bench_check(items >= PHASE_MS / 5, "pipeline delivered less than one item per 5ms");
+    if (handoff) {
+        bench_check((items > 0) && (pipeline_latency_sum / items < 1000000), "arcos_proc_yield_to() mean latency of 1ms or more");
+    }
+}
+
+#if ARCOS_CONFIG_PERIODIC
+static void phase_periodic(void) {
+    worker_next = 0;
+    for (uint8_t i=0; i<2; i++) {
+        worker_create(i, &worker_periodic, PRIO_WORKER);
+        arcos_proc_set_periodic(&worker_s[i], ARCOS_MS_TO_TICKS(periodic_ms[i][0]), 0);
+    }
+    for (uint8_t i=0; i<2; i++) {
+        arcos_proc_start(&worker_s[i]);
+    }
+    arcos_proc_sleep_ms(5 * PHASE_MS); //periods are long so host scheduling noise stays well under the slack
+    struct arcos_periodic_s stats[2];
+    for (uint8_t i=0; i<2; i++) {
+        arcos_proc_periodic_stats(&worker_s[i], &stats[i]);
+    }
+    workers_stop(2);
+    printf("periodic, %s:", ARCOS_CONFIG_SCHED_EDF ? "EDF" : "deadline monotonic");
+    for (uint8_t i=0; i<2; i++) {
+        printf(" %ums/%ums %lu jobs %lu misses worst %.2fms%s", periodic_ms[i][1], periodic_ms[i][0], (unsigned long) stats[i].jobs, (unsigned long) stats[i].misses,
+            stats[i].response_max * 1000.0 / ARCOS_CONFIG_TICK_HZ, (i == 0) ? "," : "\n");
+    }
+    bench_check((stats[0].jobs > 0) && (stats[0].misses <= BENCH_MISSES_MAX), "shorter period missed deadlines");
+    if (ARCOS_CONFIG_SCHED_EDF) {
+        bench_check((stats[1].jobs > 0) && (stats[1].misses <= BENCH_MISSES_MAX), "EDF missed deadlines at 84% utilization");
+    }
+}
+#endif
+
+//highest priority, sleeps while each phase runs
+void process_control(void) {
+    phase_throughput();
+    phase_fairness();
+    phase_starvation("busy high", &worker_spin, true);
+    phase_starvation("sleepy high", &worker_sleepy, false);
+    phase_pipeline(false);
+    phase_pipeline(true);
+#if ARCOS_CONFIG_PERIODIC
+    phase_periodic();
+#endif
+    exit(bench_failed ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+int main(void) {
+    arcos_init();
+    arcos_proc_create_stack(&control_s, &process_control, ARCOS_CONFIG_PROC_STACK_SIZE_MAX, ARCOS_STACK_POOL_SRAM, PRIO_CONTROL);
+    arcos_proc_start(&control_s);
+    arcos_start();
+}
@@ -0,0 +1,249 @@
+/*
+Cycle counts of the kernel and driver hot paths on the MSP430FR6989, collected by tools/arcos_cycles.py
+
+build in place of main.c, linked like the application, see arcos_sections.ld:
+    msp430-elf-gcc -mmcu=msp430fr6989 -mlarge -O2 -I. -I<support files> -L<support files> -L. -T msp430fr6989.ld \
+        tools/arcos_cycles.c arcos.c arc_msp_helper.c led_panel.c -o arcos_cycles.elf
+run and report:
+    python3 tools/arcos_cycles.py arcos_cycles.elf
+
+Timer2_A cannot count MCLK, so while the CPU bound paths run SMCLK is moved from MODCLK/2 to DCOCLK/1, the source of
+MCLK, and Timer2_A counts MCLK cycles exactly. MODCLK is only specified to within a few percent, so scaling SMCLK counts
+by the nominal ratio would not give cycles. led_draw() needs SMCLK on MODCLK for its SPI bit clock, so it is timed on
+ACLK from the 32768Hz crystal and converted with the MCLK of the profile. The cost of reading the timer and of the loop
+around each path is measured first and subtracted. The timeslice timer runs on SMCLK too, so the control process gets
+the longest quantum while SMCLK is fast and no path is cut by a slice interrupt.
+
+measures:
+    timer_read     - reading Timer2_A, subtracted from every other result
+    yield_switch   - arcos_proc_yield() between two processes at the same priority, one call, one context switch out and one in
+    yield_latency  - from a process calling arcos_proc_yield() to the other process returning from its own call
+    digital_write  - digitalWrite() on an output pin
+    digital_read   - digitalRead() on an input pin
+    port_isr       - from setting a port interrupt flag to the pinInterrupt() callback, entry through ISR_HANDLER()
+    led_draw_px    - led_draw() of a full frame divided by the number of pixels, includes waiting for the SPI
+*/
+
+#define ARC_MSP_USE_GPIO
+#define ARC_MSP_TYPE_msp430fr6989
+#include "arc_msp_helper.h"
+
+#include "led_panel.h"
+
+#include "arcos.h"
+
+#include <msp430.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define BENCH_N (32) //runs of each path, small enough that every measurement fits the 16-bit timer at MCLK
+#define BENCH_MAGIC (0xBE0C)
+
+#define OUT_PIN &P(9,7) //green LED
+#define IN_PIN &P(1,2) //right button
+#define ISR_PIN &P(1,1) //left button, its interrupt is triggered in software
+
+//read by tools/arcos_cycles.py, layout must match REPORT_FORMAT there
+struct bench_result_s {
+    char name[14];
+    uint16_t runs;
+    uint32_t counts; //timer counts for all runs, overhead already subtracted
+    uint32_t counts_hz; //clock Timer2_A counted, mclk_hz for paths counted in MCLK cycles
+};
+
+struct bench_report_s {
+    uint16_t magic; //BENCH_MAGIC once every result is written
+    uint16_t count;
+    uint32_t mclk_hz;
+    struct bench_result_s results[8];
+};
+
+__attribute__ ((lower))
+__attribute__ ((persistent))
+struct bench_report_s bench_report = {0};
+
+__attribute__ ((lower))
+__attribute__ ((persistent))
+uint8_t bench_fb[LED_PANEL_WIDTH*LED_PANEL_HEIGHT*3] = {0};
+
+struct arcos_proc_s bench_control_s;
+struct arcos_proc_s bench_a_s;
+struct arcos_proc_s bench_b_s;
+struct arcos_event_s bench_event;
+
+volatile uint16_t bench_stamp;
+volatile uint32_t bench_sum;
+volatile bool bench_running;
+uint16_t bench_overhead; //counts of one timer read
+
+//reads Timer2_A, ACLK is asynchronous to MCLK so it is read until two reads agree
+static inline uint16_t bench_timer(void) {
+    uint16_t t0, t1 = TA2R;
+    do {
+        t0 = t1;
+        t1 = TA2R;
+    } while (t0 != t1);
+    return t1;
+}
+
+static void bench_record(const char * name, uint16_t runs, uint32_t counts) {
+    struct bench_result_s * result = &bench_report.results[bench_report.count++];
+    strncpy(result->name, name, sizeof(result->name));
+    result->runs = runs;
+    result->counts = counts;
+    result->counts_hz = bench_report.mclk_hz;
+}
+
+//moves SMCLK between MODCLK/2, which the kernel and the LED SPI expect, and DCOCLK/1, which makes it MCLK
+//the profile is not changed while this runs, so CSCTL1 and the MCLK divider stay as arcos_os_clock_apply() left them
+static void bench_smclk_mclk(bool mclk) {
+    CSCTL0 = CSKEY; //unlock CSCTLx registers
+    if (mclk) {
+        CSCTL2 = SELA__LFXTCLK | SELS__DCOCLK | SELM__DCOCLK;
+        CSCTL3 = DIVA__1 | DIVS__1 | DIVM__1;
+    } else {
+        CSCTL2 = SELA__LFXTCLK | SELS__MODCLK | SELM__DCOCLK;
+        CSCTL3 = DIVA__1 | DIVS__2 | DIVM__1;
+    }
+    CSCTL0_H = 0; //lock CSCTLx registers
+    TA2CTL = TASSEL__SMCLK | ID__1 | MC__CONTINUOUS | TACLR;
+}
+
+//cost of reading the timer, everything below subtracts it once per measurement
+static void bench_timer_read(void) {
+    uint32_t sum = 0;
+    for (uint16_t i=0; i<BENCH_N; i++) {
+        uint16_t start = bench_timer();
+        sum += (uint16_t) (bench_timer() - start);
+    }
+    bench_overhead = sum / BENCH_N;
+    bench_record("timer_read", BENCH_N, sum);
+}
+
+//process a, yields BENCH_N times to process b, each round trip is two switches
+void bench_proc_a(void) {
+    uint16_t start = bench_timer();
+    for (uint16_t i=0; i<BENCH_N; i++) {
+        bench_stamp = bench_timer();
+        arcos_proc_yield();
+    }
+    uint16_t total = bench_timer() - start;
+    bench_running = false;
+    bench_record("yield_switch", 2 * BENCH_N, total - (((2 * BENCH_N) + 1) * bench_overhead)); //a reads the timer N+1 times, b N times
+    arcos_event_set(&bench_event, 1);
+}
+
+//process b, takes the time from a calling arcos_proc_yield() to b running again
+void bench_proc_b(void) {
+    while (true) {
+        arcos_proc_yield();
+        if (bench_running) {
+            bench_sum += (uint16_t) (bench_timer() - bench_stamp) - bench_overhead;
+        }
+    }
+}
+
+static void bench_yield(void) {
+    bench_sum = 0;
+    bench_running = true;
+    arcos_proc_create(&bench_b_s, &bench_proc_b, 0, 100);
+    arcos_proc_create(&bench_a_s, &bench_proc_a, 0, 100);
+    arcos_proc_start(&bench_b_s);
+    arcos_proc_start(&bench_a_s);
+    arcos_event_wait(&bench_event, 1);
+    arcos_proc_terminate(&bench_b_s);
+    bench_record("yield_latency", BENCH_N, bench_sum);
+}
+
+//an empty loop is timed first so only the calls are counted
+static void bench_gpio(void) {
+    volatile uint8_t sink = 0;
+    uint16_t start = bench_timer();
+    for (uint16_t i=0; i<BENCH_N; i++) {
+        __asm(" NOP \n");
+    }
+    uint16_t loop = bench_timer() - start;
+
+    start = bench_timer();
+    for (uint16_t i=0; i<BENCH_N; i++) {
+        digitalWrite(OUT_PIN, i & 1);
+    }
+    bench_record("digital_write", BENCH_N, (uint16_t) (bench_timer() - start) - loop);
+
+    start = bench_timer();
+    for (uint16_t i=0; i<BENCH_N; i++) {
+        sink += digitalRead(IN_PIN);
+    }
+    bench_record("digital_read", BENCH_N, (uint16_t) (bench_timer() - start) - loop);
+}
+
+void bench_isr_callback(void) {
+    bench_sum += (uint16_t) (bench_timer() - bench_stamp) - bench_overhead;
+}
+
+static void bench_port_isr(void) {
+    bench_sum = 0;
+    pinInterrupt(ISR_PIN, ENABLE, FALLING_EDGE, &bench_isr_callback);
+    for (uint16_t i=0; i<BENCH_N; i++) {
+        bench_stamp = bench_timer();
+        P1IFG |= BIT1; //interrupts are enabled, so the ISR runs before the next instruction
+        __asm(" NOP \n");
+    }
+    pinInterrupt(ISR_PIN, DISABLE, FALLING_EDGE, &dummy);
+    bench_record("port_isr", BENCH_N, bench_sum);
+}
+
+//one frame takes ~15ms, ~490 ACLK counts, which is far more than the timer read so it is not subtracted
+//runs with SMCLK back on MODCLK/2, which clocks the SPI
+static void bench_led_draw(void) {
+    TA2CTL = TASSEL__ACLK | ID__1 | MC__CONTINUOUS | TACLR;
+    uint16_t start = bench_timer();
+    led_draw(bench_fb);
+    uint16_t total = bench_timer() - start;
+    bench_record("led_draw_px", LED_PANEL_WIDTH * LED_PANEL_HEIGHT, total);
+    bench_report.results[bench_report.count - 1].counts_hz = ARCOS_CONFIG_CLOCK_SRC_FREQ_LFXT;
+}
+
+//the breakpoint tools/arcos_cycles.py waits for
+__attribute__ ((noinline))
+void bench_finished(void) {
+    __asm(" NOP \n");
+}
+
+void bench_control(void) {
+    bench_report.magic = 0;
+    bench_report.count = 0;
+    bench_report.mclk_hz = arcos_clock_mclk_hz();
+
+    arcos_proc_set_quantum(&bench_control_s, 26214); //the longest slice at 2.5MHz, ~4ms with SMCLK at 16MHz
+    bench_smclk_mclk(true);
+    arcos_proc_yield(); //start a slice of the new length
+    bench_timer_read();
+    bench_yield();
+    bench_gpio();
+    bench_port_isr();
+    bench_smclk_mclk(false);
+    arcos_proc_set_quantum(&bench_control_s, 0);
+    bench_led_draw();
+
+    bench_report.magic = BENCH_MAGIC;
+    bench_finished();
+}
+
+void main(void) {
+    arcos_init();
+    arc_msp_setup();
+    led_init();
+
+    pinMode(OUT_PIN, MODE_OUTPUT);
+    pinMode(IN_PIN, MODE_INPUT_PULLUP);
+    pinMode(ISR_PIN, MODE_INPUT_PULLUP);
+    arcos_event_init(&bench_event);
+
+    TA2CTL = TASSEL__SMCLK | ID__1 | MC__CONTINUOUS | TACLR; //free running, no interrupts, restarted on each clock change
+
+    arcos_proc_create(&bench_control_s, &bench_control, 0, 0);
+    arcos_proc_start(&bench_control_s);
+    arcos_start();
+}
@@ -0,0 +1,103 @@
+#!/usr/bin/env python3
+"""
+Runs the tools/arcos_cycles.c microbenchmarks on a board through mspdebug and
+reports each hot path in MCLK cycles and in microseconds at 16MHz, one JSON
+object per line, so results can be diffed or checked against a baseline.
+
+Running and reading the results with mspdebug, which this script does:
+    mspdebug tilib "prog arcos_cycles.elf" "setbreak bench_finished" "run" "save_raw bench_report <size> report.bin"
+
+The firmware counts with Timer2_A and runs the kernel in the 20-bit large
+model, so it needs the real MCU or a simulator of the MSP430X CPU and the
+FR6989 timers. mspdebug's sim driver models neither.
+
+Usage:
+    arcos_cycles.py arcos_cycles.elf > cycles.jsonl
+    arcos_cycles.py arcos_cycles.elf --baseline cycles.jsonl    exits 1 if any path got slower than the tolerance
+    arcos_cycles.py --dump report.bin                           decodes a dump saved by hand
+"""
+
+import argparse
+import json
+import os
+import struct
+import subprocess
+import sys
+import tempfile
+
+#must match struct bench_report_s and struct bench_result_s in arcos_cycles.c
+BENCH_MAGIC = 0xBE0C
+HEADER_FORMAT = "<HHI"
+RESULT_FORMAT = "<14sHII"
+RESULT_COUNT = 8
+REPORT_SIZE = struct.calcsize(HEADER_FORMAT) + RESULT_COUNT * struct.calcsize(RESULT_FORMAT)
+
+
+def run_board(elf, driver):
+    """flashes and runs the benchmark, returns the raw report"""
+    with tempfile.TemporaryDirectory() as tmp:
+        dump = os.path.join(tmp, "report.bin")
+        subprocess.run(["mspdebug", "-q", driver, "prog %s" % elf, "setbreak bench_finished", "run",
+                        "save_raw bench_report %d %s" % (REPORT_SIZE, dump)], check=True)
+        with open(dump, "rb") as f:
+            return f.read()
+
+
+def decode(data):
+    """returns a list of results, one dict per benchmark"""
+    if len(data) < REPORT_SIZE:
+        sys.exit("report is %d bytes, expected %d" % (len(data), REPORT_SIZE))
+    magic, count, mclk_hz = struct.unpack_from(HEADER_FORMAT, data, 0)
+    if magic != BENCH_MAGIC:
+        sys.exit("report is incomplete, the firmware did not reach bench_finished")
+    results = []
+    for i in range(count):
+        name, runs, counts, counts_hz = struct.unpack_from(RESULT_FORMAT, data, struct.calcsize(HEADER_FORMAT) + i * struct.calcsize(RESULT_FORMAT))
+        cycles = counts * (mclk_hz / counts_hz) / runs #counts_hz is mclk_hz for paths counted in MCLK cycles
+        results.append({"name": name.rstrip(b"\0").decode(), "runs": runs, "cycles": round(cycles, 1),
+                        "us_16mhz": round(cycles / 16, 3), "mclk_hz": mclk_hz})
+    return results
+
+
+def compare(results, baseline_path, tolerance):
+    """prints paths slower than the baseline by more than tolerance percent, returns True if there are none"""
+    with open(baseline_path) as f:
+        baseline = {entry["name"]: entry for entry in map(json.loads, filter(str.strip, f))}
+    ok = True
+    for result in results:
+        old = baseline.get(result["name"])
+        if old is None or old["cycles"] <= 0:
+            continue
+        change = 100.0 * (result["cycles"] - old["cycles"]) / old["cycles"]
+        if change > tolerance:
+            sys.stderr.write("%s: %.1f cycles, was %.1f (+%.1f%%)\n" % (result["name"], result["cycles"], old["cycles"], change))
+            ok = False
+    return ok
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("elf", nargs="?", help="arcos_cycles.elf to flash and run")
+    parser.add_argument("--driver", default="tilib", help="mspdebug driver, tilib for the LaunchPad eZ-FET")
+    parser.add_argument("--dump", help="decode a raw dump of bench_report instead of running the board")
+    parser.add_argument("--baseline", help="JSON lines from an earlier run to check against")
+    parser.add_argument("--tolerance", type=float, default=5.0, help="allowed slowdown against the baseline in percent")
+    args = parser.parse_args()
+
+    if args.dump:
+        with open(args.dump, "rb") as f:
+            data = f.read()
+    elif args.elf:
+        data = run_board(args.elf, args.driver)
+    else:
+        parser.error("give an ELF to run or --dump")
+
+    results = decode(data)
+    for result in results:
+        sys.stdout.write(json.dumps(result) + "\n")
+    if args.baseline and not compare(results, args.baseline, args.tolerance):
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,136 @@
+#!/usr/bin/env python3
+"""
+Decodes a dump of the arcos scheduler trace buffer into a Chrome trace
+(open it in chrome://tracing or https://ui.perfetto.dev).
+
+Dumping the buffer with mspdebug:
+    mspdebug tilib "sym find arcos_var_trace"
+    mspdebug tilib "save_raw <address> <2 + 4 * ARCOS_CONFIG_TRACE_SIZE> trace.bin"
+
+Usage:
+    arcos_trace.py trace.bin -n 1=startup -n 2=process1 -n 3=process2 -n 4=render > trace.json
+
+Process ids are assigned in creation order starting at 1, id 0 is the kernel.
+"""
+
+import argparse
+import json
+import struct
+import sys
+
+#must match the ARCOS_TRACE_* defines in arcos.c
+BOOT, DISPATCH, KERNEL, IDLE, YIELD, CREATE, START, TERMINATE, BLOCK, WAKE, SLEEP, ISR_ENTER, ISR_EXIT, HANDOFF, MISS = range(15)
+INSTANT_NAMES = {
+    YIELD: "yield", CREATE: "create", START: "start", TERMINATE: "terminate",
+    BLOCK: "block", WAKE: "wake", SLEEP: "sleep", HANDOFF: "handoff", MISS: "deadline miss",
+}
+ISR_NAMES = {0xFE: "sleep timer", 0xFF: "time overflow", 1: "port1", 2: "port2", 3: "port3", 4: "port4", 5: "led dma"}
+
+PID = 0 #everything runs on one CPU
+TID_IDLE = 0
+TID_ISR = 0x100 #ISRs are shown as their own threads, above every process id
+
+
+def read_records(data):
+    """returns the records of a raw buffer dump, oldest first"""
+    (head,) = struct.unpack_from("<H", data, 0)
+    size = (len(data) - 2) // 4
+    if size == 0 or size & (size - 1):
+        sys.exit("dump is %d bytes, expected 2 + 4 * a power of 2" % len(data))
+    records = [struct.unpack_from("<HBB", data, 2 + 4 * i) for i in range(size)]
+    if head <= size: #never wrapped, unless exactly 65536 records were written
+        return records[:head]
+    start = head & (size - 1)
+    return records[start:] + records[:start]
+
+
+def decode(records, names, tick_hz):
+    """turns records into a list of Chrome trace events"""
+    events = []
+    running = None #tid of the open run span
+    isr_open = []
+    now = 0
+    last = None
+    seen = set()
+
+    def us(ticks):
+        return ticks * 1000000.0 / tick_hz
+
+    def begin(tid):
+        seen.add(tid)
+        events.append({"ph": "B", "pid": PID, "tid": tid, "ts": us(now), "name": "run" if tid != TID_IDLE else "idle"})
+
+    def end(tid):
+        events.append({"ph": "E", "pid": PID, "tid": tid, "ts": us(now)})
+
+    for time, event, ident in records:
+        #the kernel records an overflow ISR every timer period, so the gap between records is always under one period
+        now += 0 if last is None else (time - last) & 0xFFFF
+        last = time
+
+        if event in (DISPATCH, IDLE, KERNEL, BOOT) and running is not None:
+            end(running)
+            running = None
+        if event == BOOT:
+            while isr_open:
+                end(isr_open.pop())
+            events.append({"ph": "i", "pid": PID, "tid": TID_IDLE, "ts": us(now), "name": "warm boot" if ident else "boot", "s": "g"})
+        elif event == DISPATCH:
+            running = ident
+            begin(running)
+        elif event == IDLE:
+            running = TID_IDLE
+            begin(running)
+        elif event == ISR_ENTER:
+            tid = TID_ISR + ident
+            seen.add(tid)
+            isr_open.append(tid)
+            events.append({"ph": "B", "pid": PID, "tid": tid, "ts": us(now), "name": ISR_NAMES.get(ident, "isr %d" % ident)})
+        elif event == ISR_EXIT:
+            tid = TID_ISR + ident
+            if tid in isr_open: #the enter may have been overwritten
+                isr_open.remove(tid)
+                end(tid)
+        elif event in INSTANT_NAMES:
+            seen.add(ident)
+            events.append({"ph": "i", "pid": PID, "tid": ident, "ts": us(now), "name": INSTANT_NAMES[event], "s": "t"})
+        elif event != KERNEL:
+            sys.stderr.write("unknown event %d at tick %d\n" % (event, now))
+
+    if running is not None:
+        end(running)
+    while isr_open:
+        end(isr_open.pop())
+
+    for tid in sorted(seen):
+        if tid == TID_IDLE:
+            name = "idle"
+        elif tid >= TID_ISR:
+            name = "ISR " + ISR_NAMES.get(tid - TID_ISR, str(tid - TID_ISR))
+        else:
+            name = names.get(tid, "process %d" % tid)
+        events.append({"ph": "M", "pid": PID, "tid": tid, "name": "thread_name", "args": {"name": name}})
+        events.append({"ph": "M", "pid": PID, "tid": tid, "name": "thread_sort_index", "args": {"sort_index": tid}})
+    return events
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("dump", help="raw dump of arcos_var_trace")
+    parser.add_argument("-n", "--name", action="append", default=[], metavar="ID=NAME", help="name a process id")
+    parser.add_argument("--tick-hz", type=float, default=32768, help="Timer1_A clock, ARCOS_CONFIG_TICK_HZ")
+    args = parser.parse_args()
+
+    names = {}
+    for entry in args.name:
+        ident, _, name = entry.partition("=")
+        names[int(ident, 0)] = name
+
+    with open(args.dump, "rb") as f:
+        data = f.read()
+    json.dump({"traceEvents": decode(read_records(data), names, args.tick_hz), "displayTimeUnit": "ms"}, sys.stdout)
+    sys.stdout.write("\n")
+
+
+if __name__ == "__main__":
+    main()